@@ -0,0 +1,419 @@
+/*
+ * Microbenchmarks of the building blocks: hash functions with each
+ * preprocessor by key length, union find, hypergraph peeling, BFS,
+ * prime tests, FastMod, and the lookups of the algorithms.
+ *
+ * The results are written as JSON in the format of Google Benchmark,
+ * so that two versions can be compared with its tools/compare.py:
+ *   MicroBench old.json
+ *   MicroBench new.json
+ *   compare.py benchmarks old.json new.json
+ *
+ * Build with -DCMAKE_BUILD_TYPE=Release for meaningful numbers.
+ * Usage: MicroBench [output.json] [filter]
+ * Only benchmarks whose name contains filter are run.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <ctime>
+#include <thread>
+#include <algorithm>
+
+#include <json/json.h>
+
+#include "randtools.hpp"
+#include "hashtools.hpp"
+#include "primetest.hpp"
+#include "unionfind.hpp"
+#include "unionfind2.hpp"
+#include "hypergraph.hpp"
+#include "graph.hpp"
+#include "bfs.hpp"
+#include "algo_bdz.hpp"
+#include "algo_chm.hpp"
+#include "algo_chd.hpp"
+#include "loadsearch.hpp"
+
+using std::size_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::string;
+using std::vector;
+
+/**
+ * Runs benchmarks and collects their results.
+ */
+class Bench {
+public:
+	using clock = std::chrono::steady_clock;
+
+private:
+	string filter;
+	double minTime = 0.2;
+	unsigned repetitions = 5;
+	Json::Value benchmarks = Json::Value(Json::arrayValue);
+
+public:
+	// results go here, so that the compiler cannot drop the work
+	volatile uint64_t sink = 0;
+
+	Bench(const string &filter) : filter(filter) {
+		// nothing
+	}
+
+	bool selected(const string &name) const {
+		return name.find(filter) != string::npos;
+	}
+
+	/**
+	 * Measure fn(), which processes items items, and record the
+	 * time per item. fn is repeated for at least minTime seconds in
+	 * each of the repetitions, the fastest repetition counts.
+	 * @param setup called before each fn() outside of the measurement
+	 */
+	template <class Setup, class Fn>
+	void run(const string &name, size_t items, Setup &&setup, Fn &&fn) {
+		if (!selected(name)) {
+			return;
+		}
+		double best = 0;
+		double bestCpu = 0;
+		uint64_t iterations = 0;
+		for (unsigned r=0; r<repetitions; r++) {
+			double real = 0;
+			double cpu = 0;
+			uint64_t it = 0;
+			while (real < minTime / repetitions) {
+				setup();
+				clock::time_point t0 = clock::now();
+				std::clock_t c0 = std::clock();
+				fn();
+				cpu += (double)(std::clock() - c0) / CLOCKS_PER_SEC;
+				real += std::chrono::duration<double>(clock::now() - t0).count();
+				it++;
+			}
+			double ns = real * 1e9 / (double)(it * items);
+			if (r == 0 || ns < best) {
+				best = ns;
+				bestCpu = cpu * 1e9 / (double)(it * items);
+				iterations = it * items;
+			}
+		}
+		Json::Value x(Json::objectValue);
+		x["name"] = name;
+		x["run_name"] = name;
+		x["run_type"] = "iteration";
+		x["repetitions"] = repetitions;
+		x["iterations"] = (Json::UInt64)iterations;
+		x["real_time"] = best;
+		x["cpu_time"] = bestCpu;
+		x["time_unit"] = "ns";
+		x["items_per_second"] = 1e9 / best;
+		benchmarks.append(x);
+		std::cerr << name << ": " << best << " ns" << std::endl;
+	}
+
+	template <class Fn>
+	void run(const string &name, size_t items, Fn &&fn) {
+		run(name, items, []() {}, fn);
+	}
+
+	void write(std::ostream &out) const {
+		Json::Value root(Json::objectValue);
+		Json::Value &ctx = root["context"];
+		std::time_t now = std::time(nullptr);
+		char date[64];
+		std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+		ctx["date"] = date;
+		ctx["num_cpus"] = std::thread::hardware_concurrency();
+#ifdef NDEBUG
+		ctx["library_build_type"] = "release";
+#else
+		ctx["library_build_type"] = "debug";
+#endif
+		root["benchmarks"] = benchmarks;
+		Json::StreamWriterBuilder builder;
+		builder["indentation"] = "  ";
+		out << Json::writeString(builder, root) << std::endl;
+	}
+};
+
+static vector<string> randomKeys(size_t count, size_t len, uint64_t seed) {
+	std::mt19937_64 r(seed);
+	vector<string> keys(count);
+	for (auto &k : keys) {
+		k.resize(len);
+		for (auto &c : k) {
+			c = (char)('a' + r() % 26);
+		}
+	}
+	return keys;
+}
+
+static map_t randomMap(size_t count, uint64_t seed) {
+	std::mt19937_64 r(seed);
+	map_t map;
+	while (map.size() < count) {
+		string k(4 + r() % 12, ' ');
+		for (auto &c : k) {
+			c = (char)('a' + r() % 26);
+		}
+		map.emplace(k, map.size());
+	}
+	return map;
+}
+
+template <class H>
+static void benchHash(Bench &b, const string &name, H &hf, const vector<string> &keys) {
+	hf.randomize();
+	b.run(name, keys.size(), [&]() {
+		uint32_t s = 0;
+		for (auto &k : keys) {
+			s += hf.hash(k);
+		}
+		b.sink = b.sink + s;
+	});
+}
+
+/**
+ * Every hash function with every preprocessor, by key length.
+ */
+static void benchHashes(Bench &b, randgen_t &randgen) {
+	for (size_t len : { 4, 16, 64 }) {
+		vector<string> keys = randomKeys(4096, len, len);
+		string suffix = "/len:" + std::to_string(len);
+		RandConst rsC0(0);
+		RandRange rs1_n(randgen, 1, 1000003);
+		RandRange rs32Bit(randgen, 0, UINT32_MAX);
+
+		PreNone none;
+		PreMult mult(len, rs1_n);
+		PreXOR xr(len, rs32Bit);
+		PreFold<PreNone> foldNone(FOLD_CASE);
+		std::pair<const char *, Preprocessor *> pres[] = {
+			{ "PreNone", &none }, { "PreMult", &mult }, { "PreXOR", &xr },
+			{ "PreFold<PreNone>", &foldNone }
+		};
+		for (auto &p : pres) {
+			p.second->randomize();
+			HashMultSum ms(*p.second, rsC0, rs1_n);
+			benchHash(b, string("hash/HashMultSum/") + p.first + suffix, ms, keys);
+			HashJenkinsOneAtATime jk(*p.second, rs32Bit);
+			benchHash(b, string("hash/HashJenkinsOneAtATime/") + p.first + suffix, jk, keys);
+		}
+
+		PreNone batchPre;
+		HashJenkinsOneAtATime batch(batchPre, rs32Bit);
+		batch.randomize();
+		vector<uint32_t> out(keys.size());
+		b.run("hash/HashJenkinsOneAtATime/PreNone/batch" + suffix, keys.size(), [&]() {
+			batch.hashBatch(keys.data(), keys.size(), out.data());
+			b.sink = b.sink + out[0];
+		});
+	}
+}
+
+/**
+ * Unions of random pairs, about as many as in BDZ with R = 2.
+ */
+template <class UF>
+static void benchUnionFind(Bench &b, const string &name, size_t n) {
+	std::mt19937_64 r(1);
+	size_t m = n * 9 / 20;
+	vector<uint32_t> ends(2 * m);
+	for (auto &x : ends) {
+		x = (uint32_t)(r() % n);
+	}
+	UF uf(n);
+	b.run(name + "/n:" + std::to_string(n), m, [&]() {
+		uf.clear();
+	}, [&]() {
+		size_t cycles = 0;
+		for (size_t i=0; i<m; i++) {
+			cycles += uf.doUnion(ends[2*i], ends[2*i + 1]);
+		}
+		b.sink = b.sink + cycles;
+	});
+}
+
+/**
+ * Building and peeling a 3-hypergraph at the load of BDZ3.
+ */
+static void benchPeel(Bench &b, size_t m) {
+	std::mt19937_64 r(2);
+	size_t part = (size_t)((double)m * 1.23 / 3) + 1;
+	vector<Hypergraph<3>::edge_t> edges(m);
+	for (auto &e : edges) {
+		for (unsigned k=0; k<3; k++) {
+			e[k] = (uint32_t)(r() % part + k * part);
+		}
+	}
+	Hypergraph<3> g(3 * part, m);
+	std::pmr::vector<size_t> seq;
+	std::pmr::vector<size_t> nodes;
+	b.run("peel/Hypergraph<3>/m:" + std::to_string(m), m, [&]() {
+		g.clear();
+		for (auto &e : edges) {
+			g.addEdge(e);
+		}
+		seq.clear();
+		nodes.clear();
+	}, [&]() {
+		b.sink = b.sink + g.peel(seq, nodes);
+	});
+}
+
+/**
+ * BFS over a random graph (a forest, like the graphs of CHM).
+ */
+static void benchBFS(Bench &b, size_t n) {
+	struct Listener {
+		uint64_t sum = 0;
+		bool root(size_t r) {
+			(void)r;
+			return true;
+		}
+		bool normalEdge(size_t p, size_t c, const Graph::edge_t &v) {
+			sum += p ^ c ^ v;
+			return true;
+		}
+		void cycleEdge(size_t p, size_t c, const Graph::edge_t &v) {
+			sum += p + c + v;
+		}
+	};
+	std::mt19937_64 r(3);
+	Graph g(n);
+	UnionFind uf(n);
+	size_t m = n * 9 / 20;
+	for (size_t i=0; i<m; i++) {
+		size_t a = r() % n;
+		size_t c = r() % n;
+		if (!uf.doUnion(a, c)) {
+			g.addEdge(a, c, i);
+		}
+	}
+	g.build();
+	BFS bfs;
+	b.run("bfs/visitAll/n:" + std::to_string(n), n, [&]() {
+		Listener l;
+		bfs.visitAll(g, l);
+		b.sink = b.sink + l.sum;
+	});
+}
+
+static void benchPrimes(Bench &b, randgen_t &randgen) {
+	std::mt19937_64 r(4);
+	vector<uint32_t> xs(1024);
+	for (auto &x : xs) {
+		x = (uint32_t)r() | 1;
+	}
+	b.run("prime/isPrime/rounds:" + std::to_string(PRIMETEST_DEFAULT_ROUNDS), xs.size(), [&]() {
+		size_t primes = 0;
+		for (uint32_t x : xs) {
+			primes += PrimeTest::isPrime(x, PRIMETEST_DEFAULT_ROUNDS, randgen);
+		}
+		b.sink = b.sink + primes;
+	});
+}
+
+static void benchMod(Bench &b) {
+	std::mt19937_64 r(5);
+	vector<uint32_t> xs(4096);
+	for (auto &x : xs) {
+		x = (uint32_t)r();
+	}
+	// a volatile divisor, so that the compiler cannot strength reduce %
+	volatile uint32_t vn = 1000003;
+	uint32_t n = vn;
+	FastMod fm(n);
+	b.run("mod/FastMod", xs.size(), [&]() {
+		uint32_t s = 0;
+		for (uint32_t x : xs) {
+			s += fm.mod(x);
+		}
+		b.sink = b.sink + s;
+	});
+	b.run("mod/operator%", xs.size(), [&]() {
+		uint32_t s = 0;
+		for (uint32_t x : xs) {
+			s += x % n;
+		}
+		b.sink = b.sink + s;
+	});
+}
+
+template <class A>
+static void benchLookup(Bench &b, randgen_t &randgen, const string &name,
+		A &algo, const map_t &map) {
+	string suffix = "/m:" + std::to_string(map.size());
+	if (!b.selected("lookup/" + name + suffix) && !b.selected("lookupBatch/" + name + suffix)) {
+		return;
+	}
+	LoadSearch search;
+	search.setBudget(0.5);
+	search.search(algo, randgen, map, 16);
+	vector<string> keys;
+	for (auto &x : map) {
+		keys.push_back(x.first);
+	}
+	std::shuffle(keys.begin(), keys.end(), std::mt19937_64(6));
+	b.run("lookup/" + name + suffix, keys.size(), [&]() {
+		uint64_t s = 0;
+		for (auto &k : keys) {
+			s += algo.lookup(k);
+		}
+		b.sink = b.sink + s;
+	});
+	vector<decltype(algo.lookup(keys[0]))> out(keys.size());
+	b.run("lookupBatch/" + name + suffix, keys.size(), [&]() {
+		algo.lookupBatch(keys.data(), keys.size(), out.data());
+		b.sink = b.sink + out[0];
+	});
+}
+
+int main(int argc, char **argv) {
+	string output = (argc > 1) ? argv[1] : "";
+	Bench b((argc > 2) ? argv[2] : "");
+	randgen_t randgen(42);
+
+	benchHashes(b, randgen);
+	for (size_t n : { 1 << 16, 1 << 22 }) {
+		benchUnionFind<UnionFind>(b, "unionfind/UnionFind", n);
+		benchUnionFind<UnionFind2>(b, "unionfind/UnionFind2", n);
+	}
+	for (size_t m : { 1 << 14, 1 << 20 }) {
+		benchPeel(b, m);
+	}
+	benchBFS(b, 1 << 20);
+	benchPrimes(b, randgen);
+	benchMod(b);
+
+	for (size_t m : { 10000, 1000000 }) {
+		map_t map = randomMap(m, m);
+		AlgoBDZ3 bdz3;
+		benchLookup(b, randgen, "AlgoBDZ3", bdz3, map);
+		AlgoBDZ3 fuse;
+		fuse.setFuse(true);
+		benchLookup(b, randgen, "AlgoBDZ3/fuse", fuse, map);
+		AlgoCHM chm;
+		benchLookup(b, randgen, "AlgoCHM", chm, map);
+		if (m <= 10000) {
+			// CHD has a fixed number of buckets and is slow to build for large m
+			AlgoCHD chd;
+			benchLookup(b, randgen, "AlgoCHD", chd, map);
+		}
+	}
+
+	if (output.empty()) {
+		b.write(std::cout);
+	} else {
+		std::ofstream out(output);
+		b.write(out);
+	}
+	return 0;
+}
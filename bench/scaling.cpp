@@ -0,0 +1,418 @@
+/*
+ * End-to-end scaling benchmark: builds every engine on synthetic key
+ * sets of growing size and reports build time, peak memory, size,
+ * trials and lookup time.
+ *
+ * The key sets are generated deterministically from a seed, so runs on
+ * different machines or versions see the same keys:
+ *   random      fixed length random alphanumeric strings
+ *   url         variable length URL-like strings with shared hosts
+ *   sequential  the integers 0, 1, 2, ... as decimal strings
+ *   prefix      a long common prefix followed by a short counter, which
+ *               is hard on hash functions that mix the characters weakly
+ *
+ * Each build runs in a child process (fork), so that the peak resident
+ * set size (getrusage) belongs to that build alone and a crash or
+ * timeout only loses one row. Linux only.
+ *
+ * Usage: ScalingBench [options]
+ *   --min M          smallest number of keys (default 1000)
+ *   --max M          largest number of keys (default 1000000)
+ *   --engines a,b    engines to run (default all, see ENGINES)
+ *   --keys a,b       key generators to run (default all)
+ *   --budget S       time budget of the load search in seconds (default 1)
+ *   --timeout S      time limit of a build in seconds (default 600)
+ *   --seed X         seed of key generation and builds (default 1)
+ *   --json FILE      also write the results as JSON
+ * The results are printed as CSV. Sizes step by factors of 10.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+#include <csignal>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <json/json.h>
+
+#include "randtools.hpp"
+#include "algo_bdz.hpp"
+#include "algo_chm.hpp"
+#include "algo_bmz.hpp"
+#include "algo_chd.hpp"
+#include "staticfunction.hpp"
+#include "loadsearch.hpp"
+#include "buildstats.hpp"
+
+using std::size_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::string;
+using std::vector;
+
+/**
+ * Deterministic synthetic key sets. The value of a key is its index.
+ */
+class KeyGen {
+private:
+	static char alnum(std::mt19937_64 &r) {
+		static const char chars[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+		return chars[r() % 36];
+	}
+
+	static string word(std::mt19937_64 &r, size_t min, size_t max) {
+		string s(min + r() % (max - min + 1), ' ');
+		for (auto &c : s) {
+			c = alnum(r);
+		}
+		return s;
+	}
+
+	static void add(map_t &map, string key) {
+		map.emplace(std::move(key), map.size());
+	}
+
+public:
+	static const vector<string> &names() {
+		static const vector<string> n = { "random", "url", "sequential", "prefix" };
+		return n;
+	}
+
+	static map_t generate(const string &kind, size_t m, uint64_t seed) {
+		std::mt19937_64 r(seed);
+		map_t map;
+		map.reserve(m);
+		if (kind == "random") {
+			while (map.size() < m) {
+				add(map, word(r, 16, 16));
+			}
+		} else if (kind == "url") {
+			// hosts and path segments from small vocabularies, so that
+			// keys share long substrings like real URLs
+			vector<string> hosts(std::max<size_t>(m / 100, 10));
+			for (auto &h : hosts) {
+				h = "www." + word(r, 3, 12) + (r() % 4 ? ".com" : ".org");
+			}
+			vector<string> segments(1000);
+			for (auto &s : segments) {
+				s = word(r, 2, 10);
+			}
+			while (map.size() < m) {
+				string key = (r() % 8 ? "https://" : "http://") + hosts[r() % hosts.size()];
+				for (size_t k = 1 + r() % 4; k > 0; k--) {
+					key += "/" + segments[r() % segments.size()];
+				}
+				if (r() % 2) {
+					key += "?id=" + std::to_string(r() % 100000);
+				}
+				add(map, std::move(key));
+			}
+		} else if (kind == "sequential") {
+			for (size_t i=0; i<m; i++) {
+				add(map, std::to_string(i));
+			}
+		} else if (kind == "prefix") {
+			string prefix(64, 'x');
+			for (auto &c : prefix) {
+				c = alnum(r);
+			}
+			for (size_t i=0; i<m; i++) {
+				string key = prefix;
+				for (size_t x=i; x>0; x/=36) {
+					key += "0123456789abcdefghijklmnopqrstuvwxyz"[x % 36];
+				}
+				add(map, std::move(key));
+			}
+		} else {
+			throw std::runtime_error("unknown key generator " + kind);
+		}
+		return map;
+	}
+};
+
+/**
+ * Measurements of one build. Plain data, it is passed through a pipe.
+ */
+struct Result {
+	bool success = false;
+	uint32_t n = 0;
+	double buildSeconds = 0;
+	size_t trials = 0;
+	size_t runs = 0;
+	size_t bytes = 0;
+	double lookupNs = 0;
+	long keysRSS = 0;
+	long peakRSS = 0;
+	char error[128] = {};
+};
+
+static long maxRSS() {
+	rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	// kilobytes on Linux
+	return ru.ru_maxrss;
+}
+
+static size_t maxLength(const map_t &map) {
+	size_t maxlen = 0;
+	for (auto &x : map) {
+		maxlen = std::max(maxlen, x.first.length());
+	}
+	return maxlen;
+}
+
+struct Options {
+	size_t minKeys = 1000;
+	size_t maxKeys = 1000000;
+	double budget = 1.0;
+	unsigned timeout = 600;
+	uint64_t seed = 1;
+};
+
+/**
+ * Build with algo and measure. Runs in the child.
+ * @param valueBits if not 0, the values are reduced to this many bits
+ */
+template <class A>
+static void measure(A &algo, unsigned valueBits, map_t &map,
+		const Options &opt, Result &res) {
+	if (valueBits > 0) {
+		for (auto &x : map) {
+			x.second &= (1u << valueBits) - 1;
+		}
+	}
+	size_t m = map.size();
+	size_t maxlen = maxLength(map);
+	res.keysRSS = maxRSS();
+
+	randgen_t randgen(opt.seed);
+	BuildStats stats;
+	algo.setStats(stats);
+	LoadSearch search;
+	search.setBudget(opt.budget);
+	auto t0 = std::chrono::steady_clock::now();
+	res.n = search.search(algo, randgen, map, maxlen);
+	res.buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	res.peakRSS = maxRSS();
+	res.trials = stats.getTrials();
+	res.runs = search.getRuns();
+	res.success = true;
+
+	// BMZ does not keep its values, so it cannot be evaluated
+	if constexpr (!std::is_same_v<A, AlgoBMZ>) {
+		res.bytes = algo.bytes();
+		// lookups in random order, of at most 1M keys to bound the time
+		vector<string> keys;
+		keys.reserve(std::min<size_t>(m, 1000000));
+		for (auto &x : map) {
+			if (keys.size() == keys.capacity()) {
+				break;
+			}
+			keys.push_back(x.first);
+		}
+		std::shuffle(keys.begin(), keys.end(), std::mt19937_64(opt.seed));
+		uint64_t sum = 0;
+		size_t count = 0;
+		auto l0 = std::chrono::steady_clock::now();
+		double t = 0;
+		while (t < 0.2) {
+			for (auto &k : keys) {
+				sum += algo.lookup(k);
+			}
+			count += keys.size();
+			t = std::chrono::duration<double>(std::chrono::steady_clock::now() - l0).count();
+		}
+		res.lookupNs = t * 1e9 / (double)count;
+		// so that the lookups are not optimized away
+		static volatile uint64_t sink;
+		sink = sum;
+	}
+}
+
+using Engine = std::function<void(map_t &, const Options &, Result &)>;
+
+template <class A>
+static Engine engine(std::function<void(A &)> configure = nullptr, unsigned valueBits = 0) {
+	return [=](map_t &map, const Options &opt, Result &res) {
+		A algo;
+		if (configure) {
+			configure(algo);
+		}
+		measure(algo, valueBits, map, opt, res);
+	};
+}
+
+static const vector<std::pair<string, Engine>> &engines() {
+	static const vector<std::pair<string, Engine>> ENGINES = {
+		{ "BDZ2", engine<AlgoBDZ2>() },
+		{ "BDZ3", engine<AlgoBDZ3>() },
+		{ "BDZ3-fuse", engine<AlgoBDZ3>([](AlgoBDZ3 &a) { a.setFuse(true); }) },
+		{ "BDZ4", engine<AlgoBDZ4>() },
+		{ "CHM", engine<AlgoCHM>() },
+		{ "BMZ", engine<AlgoBMZ>() },
+		{ "CHD", engine<AlgoCHD>() },
+		// values of 4 bits, the values of the keys are reduced to them
+		{ "StaticFunction4", engine<StaticFunction<4>>(nullptr, 4) },
+	};
+	return ENGINES;
+}
+
+/**
+ * Generate the keys and build in a child process.
+ */
+static Result runChild(const Engine &eng, const string &keys, size_t m, const Options &opt) {
+	Result res;
+	int fds[2];
+	if (pipe(fds) != 0) {
+		throw std::runtime_error("pipe failed");
+	}
+	pid_t pid = fork();
+	if (pid < 0) {
+		throw std::runtime_error("fork failed");
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		alarm(opt.timeout);
+		try {
+			map_t map = KeyGen::generate(keys, m, opt.seed);
+			eng(map, opt, res);
+		} catch (std::exception &e) {
+			std::strncpy(res.error, e.what(), sizeof(res.error) - 1);
+		}
+		ssize_t w = write(fds[1], &res, sizeof(res));
+		_exit(w == (ssize_t)sizeof(res) ? 0 : 1);
+	}
+	close(fds[1]);
+	ssize_t r = read(fds[0], &res, sizeof(res));
+	close(fds[0]);
+	int status = 0;
+	waitpid(pid, &status, 0);
+	if (r != (ssize_t)sizeof(res)) {
+		res = Result();
+		if (WIFSIGNALED(status)) {
+			std::snprintf(res.error, sizeof(res.error), "%s",
+					WTERMSIG(status) == SIGALRM ? "timeout" : strsignal(WTERMSIG(status)));
+		} else {
+			std::snprintf(res.error, sizeof(res.error), "no result");
+		}
+	}
+	return res;
+}
+
+static vector<string> split(const string &s) {
+	vector<string> v;
+	std::stringstream ss(s);
+	string x;
+	while (std::getline(ss, x, ',')) {
+		v.push_back(x);
+	}
+	return v;
+}
+
+int main(int argc, char **argv) {
+	Options opt;
+	vector<string> engineNames;
+	vector<string> keyNames = KeyGen::names();
+	string jsonFile;
+	for (auto &e : engines()) {
+		engineNames.push_back(e.first);
+	}
+	for (int i=1; i<argc; i++) {
+		string a = argv[i];
+		if (i + 1 >= argc) {
+			throw std::runtime_error("missing value of " + a);
+		}
+		string v = argv[++i];
+		if (a == "--min") {
+			opt.minKeys = (size_t)std::stod(v);
+		} else if (a == "--max") {
+			opt.maxKeys = (size_t)std::stod(v);
+		} else if (a == "--engines") {
+			engineNames = split(v);
+		} else if (a == "--keys") {
+			keyNames = split(v);
+		} else if (a == "--budget") {
+			opt.budget = std::stod(v);
+		} else if (a == "--timeout") {
+			opt.timeout = (unsigned)std::stoul(v);
+		} else if (a == "--seed") {
+			opt.seed = std::stoull(v);
+		} else if (a == "--json") {
+			jsonFile = v;
+		} else {
+			throw std::runtime_error("unknown option " + a);
+		}
+	}
+	if (opt.maxKeys > UINT32_MAX) {
+		throw std::runtime_error("too many keys");
+	}
+
+	Json::Value results(Json::arrayValue);
+	std::cout << "engine,keys,m,success,n,factor,build_s,trials,runs,bits_per_key,"
+			"lookup_ns,keys_rss_kb,peak_rss_kb,error" << std::endl;
+	for (auto &name : engineNames) {
+		auto it = std::find_if(engines().begin(), engines().end(),
+				[&](auto &e) { return e.first == name; });
+		if (it == engines().end()) {
+			throw std::runtime_error("unknown engine " + name);
+		}
+		for (auto &keys : keyNames) {
+			for (size_t m=opt.minKeys; m<=opt.maxKeys; m*=10) {
+				Result r = runChild(it->second, keys, m, opt);
+				double factor = r.n / (double)m;
+				double bits = 8.0 * (double)r.bytes / (double)m;
+				std::cout << name << "," << keys << "," << m << "," << r.success << ","
+						<< r.n << "," << factor << "," << r.buildSeconds << ","
+						<< r.trials << "," << r.runs << "," << bits << ","
+						<< r.lookupNs << "," << r.keysRSS << "," << r.peakRSS << ","
+						<< r.error << std::endl;
+
+				Json::Value x(Json::objectValue);
+				x["engine"] = name;
+				x["keys"] = keys;
+				x["m"] = (Json::UInt64)m;
+				x["success"] = r.success;
+				if (r.success) {
+					x["n"] = r.n;
+					x["factor"] = factor;
+					x["build_seconds"] = r.buildSeconds;
+					x["trials"] = (Json::UInt64)r.trials;
+					x["runs"] = (Json::UInt64)r.runs;
+					x["keys_rss_kb"] = (Json::Int64)r.keysRSS;
+					x["peak_rss_kb"] = (Json::Int64)r.peakRSS;
+					if (r.bytes > 0) {
+						x["bits_per_key"] = bits;
+						x["lookup_ns"] = r.lookupNs;
+					}
+				} else {
+					x["error"] = r.error;
+				}
+				results.append(x);
+				if (!r.success) {
+					// larger sets of this kind would fail as well
+					break;
+				}
+			}
+		}
+	}
+
+	if (!jsonFile.empty()) {
+		std::ofstream out(jsonFile);
+		Json::StreamWriterBuilder builder;
+		builder["indentation"] = "\t";
+		out << Json::writeString(builder, results) << std::endl;
+	}
+	return 0;
+}
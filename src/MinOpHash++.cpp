@@ -18,10 +18,18 @@
 #include "hashtools.hpp"
 #include "algo_chm.hpp"
 #include "algo_bmz.hpp"
-#include "algo_bdz2.hpp"
-#include "algo_bdz3.hpp"
+#include "algo_bdz.hpp"
 #include "algo_chd.hpp"
-#include "graph3.hpp"
+#include "fingerprints.hpp"
+#include "staticmap.hpp"
+#include "staticfunction.hpp"
+#include "xorfilter.hpp"
+#include "loadsearch.hpp"
+#include "buildstats.hpp"
+#include "trace.hpp"
+#include "perfcounters.hpp"
+#include "verifier.hpp"
+#include "buildcache.hpp"
 
 using std::size_t;
 using std::uint32_t;
@@ -110,6 +118,7 @@ void testIsPrime(R &randgen) {
 }
 
 void loadJSON(map_t &map, string filename) {
+	Trace::Scope scope("load keys");
 	std::ifstream input(filename);
 	if (input.fail()) {
 		throw std::runtime_error("failed to open file");
@@ -175,16 +184,172 @@ std::pair<size_t, size_t> minMax(const map_t &map) {
 }
 
 
+/**
+ * Make sure that no two keys become equal by folding.
+ */
+void checkFolding(const map_t &map, unsigned flags) {
+	Trace::Scope scope("check folding");
+	if (flags == FOLD_NONE) {
+		return;
+	}
+	CharFold fold(flags);
+	unordered_map<string, const string *> folded;
+	for (auto &x : map) {
+		auto r = folded.insert(std::make_pair(fold.apply(x.first), &x.first));
+		if (!r.second) {
+			throw std::runtime_error("keys \"" + *r.first->second + "\" and \""
+					+ x.first + "\" collide after folding");
+		}
+	}
+}
+
+
+/**
+ * Search n for the keys of map and leave algo with the function for it.
+ */
+template <class A>
+uint32_t searchN(A &algo, randgen_t &randgen, const map_t &map, size_t maxlen,
+		LoadSearch &search) {
+	Trace::Scope scope("search");
+	uint32_t n = search.search(algo, randgen, map, maxlen);
+	size_t m = map.size();
+	std::cout << "m = " << m << " and n = " << n
+			<< " (factor " << n/(double)m << ", " << search.getRuns() << " runs in "
+			<< search.getTime() << " s)" << std::endl;
+	return n;
+}
+
+/**
+ * Like searchN, but reuse n and the trial seed of an earlier build of
+ * the same keys and params from the build cache.
+ */
+template <class A>
+uint32_t buildCached(A &algo, randgen_t &randgen, const map_t &map, size_t maxlen,
+		LoadSearch &search, const string &params) {
+	BuildCache cache(".build-cache");
+	uint32_t n = cache.build(algo, map, maxlen, params, search, randgen());
+	size_t m = map.size();
+	if (cache.isHit()) {
+		std::cout << "m = " << m << " and n = " << n
+				<< " (factor " << n/(double)m << ", from the build cache)" << std::endl;
+	} else {
+		std::cout << "m = " << m << " and n = " << n
+				<< " (factor " << n/(double)m << ", " << search.getRuns() << " runs in "
+				<< search.getTime() << " s)" << std::endl;
+	}
+	return n;
+}
+
+
+/**
+ * Build a static map with values and fingerprints on f (not with CHM).
+ */
+template <class F>
+void buildStaticMap(F &f, randgen_t &randgen, const map_t &map, unsigned folding) {
+	Trace::Scope scope("static map");
+	StaticMap<F> smap(f);
+	smap.build(randgen, map, folding, 16);
+	std::cout << "static map: " << smap.bytes() << " bytes"
+			<< (smap.isDictEncoded() ? " (dictionary encoded)" : "") << std::endl;
+}
+
+
+/**
+ * Build a filter that rejects most keys not in the map before a lookup.
+ */
+void buildFilter(randgen_t &randgen, const map_t &map, unsigned folding,
+		BuildContext &ctx, size_t trials) {
+	Trace::Scope scope("filter");
+	FuseFilter8 f;
+	// XorFilter8 f;
+	f.setFolding(folding);
+	f.setBuildContext(ctx);
+	if (!f.build(randgen, map, trials)) {
+		throw std::runtime_error("failed to build filter");
+	}
+	std::cout << "filter: " << f.bytes() << " bytes" << std::endl;
+}
+
+
+/**
+ * Build fingerprints on f that reject most keys not in the map (not
+ * with CHM).
+ */
+template <class F>
+void buildFingerprints(F &f, randgen_t &randgen, const map_t &map, unsigned folding) {
+	Trace::Scope scope("fingerprints");
+	Fingerprints<F> fps(f);
+	fps.build(randgen, map, folding, 8);
+	std::cout << "fingerprints: " << fps.bytes() << " bytes" << std::endl;
+}
+
+
+/**
+ * Write the trials, failures, and phase times of all runs as JSON.
+ */
+template <class A>
+void writeStats(BuildStats &stats, const A &algo, const string &filename) {
+	stats.setBytes(algo.bytes());
+	std::ofstream out(filename);
+	stats.write(out);
+}
+
+
+/**
+ * Print the hardware counters of looking up all keys, per key.
+ */
+template <class A>
+void countLookups(A &algo, const map_t &map, const PerfCounters &perf) {
+	Trace::Scope scope("count lookups");
+	vector<string> keys;
+	keys.reserve(map.size());
+	for (auto &x : map) {
+		keys.push_back(x.first);
+	}
+	uint64_t sum = 0;
+	PerfCounters::Sample before = perf.read();
+	for (auto &key : keys) {
+		sum += algo.lookup(key);
+	}
+	PerfCounters::Sample after = perf.read();
+	std::cout << "lookups (checksum " << sum << "):" << std::endl;
+	perf.write(std::cout, after - before, (double)map.size());
+}
+
+
+/**
+ * Check the finished function for every key with all threads.
+ */
+template <class A>
+void verify(A &algo, const map_t &map) {
+	Verifier verifier;
+	bool ok = verifier.perfect(map, [&](const string &key) { return algo.lookup(key); });
+	// bool ok = verifier.values(map, [&](const string &key) { return algo.lookup(key); }); // AlgoCHM, StaticFunction
+	// bool ok = verifier.values(map, [&](const string &key) { return algo.lookupValue(key); }); // order preserving AlgoBDZ
+	if (!ok) {
+		verifier.write(std::cerr);
+		throw std::runtime_error("verification failed");
+	}
+	std::cout << "verified " << map.size() << " keys" << std::endl;
+}
+
+
 int main(int argc, char **argv) {
 	(void)argc;
 	(void)argv;
 
 	randgen_t randgen;
 	seedMT(randgen);
+	// randgen.seed(42); // a fixed seed makes builds reproducible
 
 //	testFastMod();
 //	testIsPrime(randgen);
 
+	// timeline of the construction for chrome://tracing or Perfetto,
+	// written to build-trace.json at the end
+	Trace trace;
+	// trace.activate();
+
 	std::cout << std::filesystem::current_path() << std::endl;
 
 	unordered_map<string, edge_t> map;
@@ -205,47 +370,65 @@ int main(int argc, char **argv) {
 		throw std::runtime_error("too many words");
 	}
 
+	unsigned folding = FOLD_NONE;
+	// unsigned folding = FOLD_CASE;
+	// unsigned folding = FOLD_CASE | FOLD_DASH;
+	checkFolding(map, folding);
+
 	size_t minlen, maxlen;
 	std::tie(minlen, maxlen) = minMax(map);
 
 	std::cout << "minlen = " << minlen << " and maxlen = " << maxlen << std::endl;
 
-	size_t m = map.size();
-	uint64_t min = 2;
-
 	size_t trials = 1000;
 
 	// AlgoCHM algo;
 	// AlgoBMZ algo;
 	AlgoBDZ2 algo;
 	// AlgoBDZ3 algo;
+	// AlgoBDZ4 algo;
 	// AlgoCHD algo;
-
-	double fi = algo.factor_init();
-	double f = algo.factor_inc();
-	for (double n = (double)m * fi; ; n *= f) {
-		uint64_t ni64 = (uint64_t)(n + 0.5);
-		if (ni64 > UINT32_MAX) {
-			throw std::runtime_error("too many elements");
-		}
-
-		uint32_t ni32 = (uint32_t)ni64;
-		while (!PrimeTest::isPrime(ni32, PRIMETEST_DEFAULT_ROUNDS, randgen)) {
-			ni32++;
-		}
-		if (ni32 < min) {
-			continue;
-		}
-		min = (uint64_t)ni32 + 1;
-
-		std::cout << "m = " << m << " and n = " << ni32
-				<< " (factor " << ni32/(double)m << ")" << std::endl;
-
-		if (algo.run(randgen, map, maxlen, ni32, trials)) {
-			break;
-		}
-		// std::cout << "failed" << std::endl;
-		// return 1;
+	// StaticFunction<4> algo; // values of a dictionary with 4 bit values
+	algo.setFolding(folding);
+	// algo.setOrderPreserving(true);
+	// algo.setFuse(true); // AlgoBDZ3 only
+	// algo.setThreads(Parallel::hardwareThreads()); // AlgoBDZ and AlgoCHM
+	// scratch memory of all runs, shared with the filter below
+	BuildContext ctx;
+	algo.setBuildContext(ctx);
+	// statistics of the runs, for writeStats() below
+	// BuildStats stats;
+	// stats.setName("BDZ2");
+	// algo.setStats(stats);
+	// hardware counters, per phase in the stats and for countLookups() below
+	// PerfCounters perf;
+	// stats.setPerf(perf);
+
+	LoadSearch search;
+	search.setBudget(1.0);
+	search.setTrials(4, trials);
+	searchN(algo, randgen, map, maxlen, search);
+	// everything that changes the function goes into the parameters
+	// buildCached(algo, randgen, map, maxlen, search, "BDZ2 folding=" + std::to_string(folding));
+
+	std::cout << "scratch memory: " << ctx.getHighWater() << " bytes" << std::endl;
+
+	verify(algo, map);
+
+	// writeStats(stats, algo, "build-stats.json");
+
+	// countLookups(algo, map, perf);
+
+	// buildFingerprints(algo, randgen, map, folding);
+
+	// buildStaticMap(algo, randgen, map, folding);
+
+	// buildFilter(randgen, map, folding, ctx, trials);
+
+	if (Trace::active() == &trace) {
+		trace.deactivate();
+		std::ofstream out("build-trace.json");
+		trace.write(out);
 	}
 	return 0;
 }
@@ -0,0 +1,523 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <memory>
+
+#include "randtools.hpp"
+#include "hashtools.hpp"
+#include "bitarray.hpp"
+#include "rank.hpp"
+#include "valuetable.hpp"
+#include "unionfind.hpp"
+#include "concurrentunionfind.hpp"
+#include "hypergraph.hpp"
+#include "fuse.hpp"
+#include "parallel.hpp"
+#include "buildcontext.hpp"
+#include "buildstats.hpp"
+#include "algo.hpp"
+
+/* Idea:
+ * Each key is an edge of a hypergraph with R nodes, one in each of R
+ * parts of n nodes. If the hypergraph can be peeled, the nodes are
+ * assigned values in [0,R) in reverse order of removal, such that the
+ * values of the nodes of an edge add up (mod R) to the position of the
+ * node that was removed with the edge. That node is the value of the
+ * perfect hash function. For R = 2, peeling succeeds if and only if
+ * the graph is acyclic, which union find detects early.
+ *
+ * For compressing the range of the hash function we store
+ * bit masks and counters (see RankDirectory).
+ * Idea:
+ * Instead of the RankDirectory, the unused nodes could be marked with
+ * the value 3 (for R = 3). That can be done by ANDing the two bits of
+ * each value and checking for 1 bits (popcount).
+ *
+ * Space for 10000 words:
+ * R = 2: 9371 * 2 * (1/8 + 6/32) = 5856.875 bytes
+ * R = 3: 4049 * 3 * (2/8 + 2/32) = 3795.9375 bytes
+ * R = 4: 3229 * 4 * (2/8 + 2/32) = 4036.25 bytes
+ * R = 4 needs the fewest nodes, but R = 3 the fewest bits because
+ * its nodes need 2 bits for 3 values.
+ *
+ * In fuse mode (R = 3 only), the hypergraph is spatially coupled (see
+ * FuseLayout): the three nodes of a key lie in consecutive segments,
+ * so the load can be about 1/1.125 for large key sets (about 10% less
+ * space) and the three probes of a lookup are close to each other.
+ *
+ * With threads, the hypergraph is peeled in synchronous rounds (see
+ * Hypergraph::peelRounds) and the nodes of each round are assigned in
+ * parallel. For R = 2, the threads also check the graph for cycles
+ * with a ConcurrentUnionFind. Without threads, Hypergraph::peel removes
+ * the edges in the same order, so the generated function does not depend
+ * on the number of threads.
+ *
+ * All scratch memory of a run (hypergraph, union find, peeling order,
+ * used nodes) comes from a BuildContext, so further trials and runs
+ * with other n allocate nothing but the generated function.
+ */
+
+template <unsigned R>
+class AlgoBDZ {
+private:
+	using string = std::string;
+	using size_t = std::size_t;
+	using vector = std::pmr::vector<size_t>;
+	using graph_t = Hypergraph<R>;
+	using edge_t = typename graph_t::edge_t;
+
+	// bits per g value
+	static constexpr unsigned WIDTH = (R == 2) ? 1 : 2;
+
+	unsigned folding = FOLD_NONE;
+	size_t depth = 32;
+	RankDirectory::Overhead rankOverhead = RankDirectory::OVERHEAD_6;
+	bool orderPreserving = false;
+	bool fuse = false;
+	unsigned threads = 0;
+	BuildContext context;
+	BuildContext *ctx = &context;
+	BuildStats noStats { false };
+	BuildStats *stats = &noStats;
+	TrialSeeds trialSeeds;
+
+	// the generated function, one hash function per node of an edge
+	std::unique_ptr<HashFuncs<R>> funcs;
+	uint32_t n = 0;
+	FastMod fm;
+	FuseLayout layout;
+	PackedArray g;
+	RankDirectory rank;
+	ValueTable values;
+
+	static uint32_t modR(uint32_t s) {
+		if constexpr (R == 3) {
+			static const uint8_t mod3[7] = { 0, 1, 2, 0, 1, 2, 0 };
+			return mod3[s];
+		} else {
+			return s & (R - 1);
+		}
+	}
+
+	/**
+	 * The nodes of a key from its R hashes.
+	 */
+	void nodes(edge_t &h) const {
+		if constexpr (R == 3) {
+			if (fuse) {
+				layout.nodes(h[0], FuseLayout::mix(h[1], h[2]), h[0], h[1], h[2]);
+				return;
+			}
+		}
+		graph_t::each([&](unsigned k) {
+			h[k] = fm.mod(h[k]) + k * n;
+		});
+	}
+
+	edge_t edge(const string &key) const {
+		edge_t h;
+		graph_t::each([&](unsigned k) {
+			h[k] = funcs->hf[k].hash(key);
+		});
+		nodes(h);
+		return h;
+	}
+
+	uint32_t slot(const edge_t &e) const {
+		uint32_t s = 0;
+		graph_t::each([&](unsigned k) {
+			s += (uint32_t)g.get(e[k]);
+		});
+		return e[modR(s)];
+	}
+
+	/**
+	 * Value of the node removed with an edge, such that the values of
+	 * the edge's nodes add up to the position of that node.
+	 */
+	uint32_t value(const edge_t &e, size_t node) const {
+		uint32_t j = 0;
+		uint32_t s = 0;
+		graph_t::each([&](unsigned k) {
+			if (e[k] == node) {
+				j = k;
+			}
+			s += (uint32_t)g.get(e[k]);
+		});
+		return (j + R*R - s) % R;
+	}
+
+	/**
+	 * Assign values to nodes in reverse order of removal.
+	 */
+	void assign(const graph_t &gr, const vector &seq, const vector &nodes) {
+		g.assign(gr.getN(), WIDTH);
+		for (size_t i = seq.size(); i-- > 0; ) {
+			g.set(nodes[i], value(gr.getEdge(seq[i]), nodes[i]));
+		}
+	}
+
+	/**
+	 * Assign values to nodes in reverse order of the peeling rounds.
+	 * The edges of a round do not contain the nodes removed with other
+	 * edges of the same round, so their values are computed in parallel
+	 * (and then stored by one thread, because they share words of g).
+	 */
+	void assignRounds(const graph_t &gr, const vector &seq, const vector &nodes,
+			const vector &rounds) {
+		g.assign(gr.getN(), WIDTH);
+		std::pmr::vector<uint8_t> vals(seq.size(), ctx);
+		for (size_t r = rounds.size(); r-- > 0; ) {
+			size_t start = (r > 0) ? rounds[r-1] : 0;
+			size_t end = rounds[r];
+			Parallel::forRange(threads, end - start, [&](size_t b, size_t e, unsigned t) {
+				(void)t;
+				for (size_t i = start + b; i < start + e; i++) {
+					vals[i] = (uint8_t)value(gr.getEdge(seq[i]), nodes[i]);
+				}
+			});
+			for (size_t i = start; i < end; i++) {
+				g.set(nodes[i], vals[i]);
+			}
+		}
+	}
+
+public:
+	static constexpr size_t BATCH = 256;
+
+	/**
+	 * Set the character folding (FOLD_* flags) applied by the hash functions.
+	 */
+	void setFolding(unsigned flags) {
+		folding = flags;
+	}
+
+	/**
+	 * If enabled, the values of the map are stored in addition to the
+	 * minimal perfect hash function and returned by lookupValue.
+	 */
+	void setOrderPreserving(bool enable) {
+		orderPreserving = enable;
+	}
+
+	/**
+	 * If enabled, the hypergraph is spatially coupled instead of having
+	 * R independent parts, only for R = 3.
+	 */
+	void setFuse(bool enable) {
+		if (enable && R != 3) {
+			throw std::runtime_error("fuse mode requires 3 nodes per edge");
+		}
+		fuse = enable;
+	}
+
+	/**
+	 * Set the number of threads that peel the hypergraph. 0 (the default)
+	 * selects the sequential peeler, from 1 on the round-synchronous one.
+	 * Both generate the same function.
+	 */
+	void setThreads(unsigned t) {
+		threads = t;
+	}
+
+	/**
+	 * Set the space overhead of the rank directory used to make the
+	 * function minimal.
+	 */
+	void setRankOverhead(RankDirectory::Overhead o) {
+		rankOverhead = o;
+	}
+
+	/**
+	 * Set the number of keys whose g values are prefetched together
+	 * by lookupBatch, at most BATCH.
+	 */
+	void setPrefetchDepth(size_t d) {
+		if (d == 0 || d > BATCH) {
+			throw std::runtime_error("invalid prefetch depth");
+		}
+		depth = d;
+	}
+
+	/**
+	 * Take the scratch memory of builds from a context that may be
+	 * shared with other algorithms, instead of an own one.
+	 */
+	void setBuildContext(BuildContext &c) {
+		ctx = &c;
+	}
+
+	BuildContext &getBuildContext() {
+		return *ctx;
+	}
+
+	/**
+	 * Report the trials, failures and phase times of runs to s.
+	 */
+	void setStats(BuildStats &s) {
+		stats = &s;
+	}
+
+	/**
+	 * Seeds of the trials, for reproducible builds.
+	 */
+	TrialSeeds &getTrialSeeds() {
+		return trialSeeds;
+	}
+
+	double factor_init() {
+		switch (R) {
+		case 2:
+			return 0.9;
+		case 3:
+			return fuse ? 0.37 : 0.38;
+		default:
+			return 0.31;
+		}
+	}
+	/**
+	 * Load factor n/m below which runs (almost) never succeed.
+	 */
+	double factor_min(size_t m) {
+		switch (R) {
+		case 2:
+			// the graph is acyclic with probability sqrt(1 - (m/n)^2)
+			return 1.0;
+		case 3:
+			// peelability thresholds of random hypergraphs, per part
+			return fuse ? FuseLayout::sizeFactor(m) / R : 1.2219 / R;
+		default:
+			return 1.2955 / R;
+		}
+	}
+	double factor_inc() {
+		return 1.02;
+	}
+
+	bool run(randgen_t &randgen, const map_t &map,
+			size_t maxlen, uint32_t n, size_t trials) {
+		(void)maxlen;
+		ctx->reset();
+		stats->beginRun(map.size(), n);
+		Trace::Scope scope("AlgoBDZ::run", "n", n);
+
+		size_t nodeCount = R * (size_t)n;
+		if (fuse) {
+			// small n need shorter segments
+			unsigned bits = FuseLayout::segmentBitsFor(map.size());
+			while (bits > 0 && (nodeCount >> bits) < 3) {
+				bits--;
+			}
+			layout = FuseLayout(nodeCount, bits);
+			nodeCount = layout.size();
+		}
+		graph_t gr(nodeCount, map.size(), ctx);
+		std::unique_ptr<UnionFind> uf;
+		std::unique_ptr<ConcurrentUnionFind> cuf;
+		std::pmr::vector<const string *> keys(ctx);
+		if constexpr (R == 2) {
+			if (threads == 0) {
+				uf = std::make_unique<UnionFind>(nodeCount, ctx);
+			} else {
+				cuf = std::make_unique<ConcurrentUnionFind>(nodeCount, ctx);
+				// slices of keys for the threads
+				keys.reserve(map.size());
+				for (auto &x : map) {
+					keys.push_back(&x.first);
+				}
+			}
+		}
+
+		this->n = n;
+		fm = FastMod(n);
+		RandRange rs32Bit(randgen, 0, UINT32_MAX);
+		funcs = std::make_unique<HashFuncs<R>>(folding, rs32Bit);
+
+		vector edgeSeq(ctx);
+		vector nodeSeq(ctx);
+		vector rounds(ctx);
+		edgeSeq.reserve(map.size());
+		nodeSeq.reserve(map.size());
+		std::pmr::vector<bool> used(ctx);
+		for (size_t i=0; i<trials; i++) {
+			trialSeeds.reseed(randgen, n, i);
+			funcs->randomize();
+			stats->trial();
+
+			if constexpr (R == 2) {
+				// find acyclic graph using union find
+				auto t = stats->now();
+				bool cycle = false;
+				if (threads == 0) {
+					uf->clear();
+					for (auto &x : map) {
+						edge_t e = edge(x.first);
+						if (uf->doUnion(e[0], e[1])) {
+							// cycle or parallel detected
+							cycle = true;
+							break;
+						}
+					}
+				} else {
+					cuf->clear(threads);
+					cycle = cuf->findCycle(threads, keys.size(),
+							[&](size_t k, size_t &a, size_t &b) {
+						edge_t e = edge(*keys[k]);
+						a = e[0];
+						b = e[1];
+					});
+				}
+				stats->phase(BuildStats::PHASE_CHECK, t);
+				if (threads == 0) {
+					stats->unionFindDepth(uf->maxDepth());
+				}
+				if (cycle) {
+					stats->failure(BuildStats::CYCLE);
+					continue;
+				}
+			}
+
+			auto t = stats->now();
+			gr.clear();
+			for (auto &x : map) {
+				gr.addEdge(edge(x.first));
+			}
+			stats->phase(BuildStats::PHASE_HASH, t);
+
+			edgeSeq.clear();
+			nodeSeq.clear();
+			rounds.clear();
+			t = stats->now();
+			size_t mc = (threads == 0) ? gr.peel(edgeSeq, nodeSeq)
+					: gr.peelRounds(edgeSeq, nodeSeq, rounds, threads);
+			stats->phase(BuildStats::PHASE_PEEL, t);
+			if (mc != map.size()) {
+				if constexpr (R == 2) {
+					// acyclic graphs can always be peeled
+					throw std::runtime_error("internal error");
+				}
+				//FIXME this fails because of parallels, example edges:
+				// (0,4,7), (1,4,7), (1,4,7)
+				stats->failure(BuildStats::NOT_PEELABLE);
+				stats->core(map.size() - mc);
+				continue;
+			}
+
+			t = stats->now();
+			if (threads == 0) {
+				assign(gr, edgeSeq, nodeSeq);
+			} else {
+				assignRounds(gr, edgeSeq, nodeSeq, rounds);
+			}
+			stats->phase(BuildStats::PHASE_ASSIGN, t);
+			t = stats->now();
+
+			// sanity check and compress [0,nodeCount) to [0,m)
+			used.assign(nodeCount, false);
+			for (size_t eidx = 0; eidx < map.size(); eidx++) {
+				size_t idx = slot(gr.getEdge(eidx));
+				if (used[idx]) {
+					throw std::runtime_error("sanity check failed");
+				}
+				used[idx] = true;
+			}
+			rank.build(used, rankOverhead);
+
+			if (orderPreserving) {
+				values.build(*this, map);
+			} else {
+				values = ValueTable();
+			}
+			stats->phase(BuildStats::PHASE_COMPRESS, t);
+			stats->endRun(true);
+			return true;
+		}
+		this->n = 0;
+		stats->endRun(false);
+		return false;
+	}
+
+	/**
+	 * Size of the function found by the last successful run.
+	 */
+	size_t bytes() const {
+		return g.bytes() + rank.bytes() + values.bytes();
+	}
+
+	/**
+	 * Evaluate the function found by the last successful run.
+	 * @return value in [0,m)
+	 */
+	uint32_t lookup(const string &key) {
+		return rank.rank(slot(edge(key)));
+	}
+
+	/**
+	 * Evaluate the function for several keys, out[i] receives lookup(keys[i]).
+	 * Blocks of keys are hashed first and their g values are prefetched
+	 * before any of them is resolved. The same is done for the rank
+	 * directory.
+	 */
+	void lookupBatch(const string *keys, size_t count, uint32_t *out) {
+		uint32_t h[R][BATCH];
+		edge_t e[BATCH];
+		for (size_t b=0; b<count; b+=depth) {
+			size_t k = std::min(depth, count - b);
+			graph_t::each([&](unsigned r) {
+				funcs->hf[r].hashBatch(keys + b, k, h[r]);
+			});
+			for (size_t i=0; i<k; i++) {
+				graph_t::each([&](unsigned r) {
+					e[i][r] = h[r][i];
+				});
+				nodes(e[i]);
+				graph_t::each([&](unsigned r) {
+					__builtin_prefetch(g.address(e[i][r]));
+				});
+			}
+			for (size_t i=0; i<k; i++) {
+				out[b+i] = slot(e[i]);
+				__builtin_prefetch(rank.address(out[b+i]));
+			}
+			for (size_t i=0; i<k; i++) {
+				out[b+i] = rank.rank(out[b+i]);
+			}
+		}
+	}
+
+	/**
+	 * The value of the key in the map, requires order preserving mode.
+	 */
+	uint64_t lookupValue(const string &key) {
+		if (values.empty()) {
+			throw std::runtime_error("not order preserving");
+		}
+		return values.get(lookup(key));
+	}
+
+	/**
+	 * Look up the values of several keys, out[i] receives lookupValue(keys[i]).
+	 */
+	void lookupValueBatch(const string *keys, size_t count, uint64_t *out) {
+		if (values.empty()) {
+			throw std::runtime_error("not order preserving");
+		}
+		uint32_t idx[BATCH];
+		for (size_t b=0; b<count; b+=BATCH) {
+			size_t k = std::min(BATCH, count - b);
+			lookupBatch(keys + b, k, idx);
+			for (size_t i=0; i<k; i++) {
+				__builtin_prefetch(values.address(idx[i]));
+			}
+			for (size_t i=0; i<k; i++) {
+				out[b+i] = values.get(idx[i]);
+			}
+		}
+	}
+};
+
+using AlgoBDZ2 = AlgoBDZ<2>;
+using AlgoBDZ3 = AlgoBDZ<3>;
+using AlgoBDZ4 = AlgoBDZ<4>;
@@ -4,26 +4,29 @@
 #include <string>
 
 #include "randtools.hpp"
+#include "hashtools.hpp"
 #include "unionfind.hpp"
 #include "graph.hpp"
 #include "bfs.hpp"
+#include "buildcontext.hpp"
+#include "buildstats.hpp"
 #include "algo.hpp"
 
 class AlgoBMZ {
 private:
 	using string = std::string;
-	using edge_t = GraphSimple::edge_t;
-	using vector = std::vector<edge_t>;
-	using vectorb = std::vector<bool>;
+	using edge_t = Graph::edge_t;
+	using vector = std::pmr::vector<edge_t>;
+	using vectorb = std::pmr::vector<bool>;
 
 	class CoreFinder {
 	private:
-		GraphSimple &g;
+		Graph &g;
 		vectorb &core;
 	public:
 		size_t nonCoreEdgesTimes2 = 0;
 
-		CoreFinder(GraphSimple &g, vectorb &core) : g(g), core(core) {
+		CoreFinder(Graph &g, vectorb &core) : g(g), core(core) {
 			core.assign(g.getN(), true);
 		}
 
@@ -62,13 +65,13 @@ private:
 
 	class CoreAssigner {
 	private:
-		GraphSimple &g;
+		Graph &g;
 		vectorb &core;
 	public:
 		vector values;
 
-		CoreAssigner(GraphSimple &g, vectorb &core)
-			: g(g), core(core), values(g.getN(), 0) {
+		CoreAssigner(Graph &g, vectorb &core)
+			: g(g), core(core), values(g.getN(), 0, core.get_allocator()) {
 			// nothing
 		}
 
@@ -92,10 +95,58 @@ private:
 		}
 	};
 
+	unsigned folding = FOLD_NONE;
+	BuildContext context;
+	BuildContext *ctx = &context;
+	BuildStats noStats { false };
+	BuildStats *stats = &noStats;
+	TrialSeeds trialSeeds;
+
 public:
+	/**
+	 * Set the character folding (FOLD_* flags) applied by the hash functions.
+	 */
+	void setFolding(unsigned flags) {
+		folding = flags;
+	}
+
+	/**
+	 * Take the scratch memory of builds from a context that may be
+	 * shared with other algorithms, instead of an own one.
+	 */
+	void setBuildContext(BuildContext &c) {
+		ctx = &c;
+	}
+
+	BuildContext &getBuildContext() {
+		return *ctx;
+	}
+
+	/**
+	 * Report the trials, failures and phase times of runs to s.
+	 */
+	void setStats(BuildStats &s) {
+		stats = &s;
+	}
+
+	/**
+	 * Seeds of the trials, for reproducible builds.
+	 */
+	TrialSeeds &getTrialSeeds() {
+		return trialSeeds;
+	}
+
 	double factor_init() {
 		return 1.3;
 	}
+	/**
+	 * Load factor n/m below which runs (almost) never succeed.
+	 */
+	double factor_min(size_t m) {
+		(void)m;
+		// the 2-core is small enough from about 1.15 on (see the paper)
+		return 1.15;
+	}
 	double factor_inc() {
 		return 1.02;
 	}
@@ -104,28 +155,35 @@ public:
 	bool run(randgen_t &randgen, const map_t &map,
 			size_t maxlen, uint32_t n, size_t trials) {
 
-		GraphSimple g(n);
+		ctx->reset();
+		stats->beginRun(map.size(), n);
+		Trace::Scope scope("AlgoBMZ::run", "n", n);
+		Graph g(n, ctx);
+		BFS bfs(ctx);
 
 		RandConst rsC0(0);
 		RandConst rsC1(1);
 		RandRange rs0_n(randgen, 0, n-1);
 		RandRange rs1_n(randgen, 1, n-1);
 
-		PreMult pre1(maxlen, rs1_n);
-		PreMult pre2(maxlen, rs1_n);
+		PreFold<PreMult> pre1(folding, maxlen, rs1_n, ctx);
+		PreFold<PreMult> pre2(folding, maxlen, rs1_n, ctx);
 		HashMultSum hf1(pre1, rsC0, rsC1);
 		HashMultSum hf2(pre2, rs0_n, rsC1);
 
-		vectorb core;
+		vectorb core(ctx);
 
 		bool runagain = true;
 		for (size_t i=0; runagain && i<trials; i++) {
+			trialSeeds.reseed(randgen, n, i);
 			pre1.randomize();
 			pre2.randomize();
 			hf1.randomize();
 			hf2.randomize();
 			g.clear();
+			stats->trial();
 
+			auto t = stats->now();
 			runagain = false;
 			for (auto &x : map) {
 				const string &key = x.first;
@@ -148,40 +206,49 @@ public:
 				}
 				if (h1 == h2) {
 					// loop detected
-//					std::cout << "loop" << std::endl;
-					runagain = true;
-					break;
-				}
-				bool r = g.addEdge(h1, h2, x.second);
-				if (!r) {
-					//parallel detected
-//					std::cout << "parallel" << std::endl;
+					stats->failure(BuildStats::LOOP);
 					runagain = true;
 					break;
 				}
+				g.addEdge(h1, h2, x.second);
 			}
 
+			stats->phase(BuildStats::PHASE_HASH, t);
 			if (runagain) {
 				continue;
 			}
 
-			BFS bfs;
+			t = stats->now();
+			g.build();
+			if (g.hasParallels()) {
+				//parallel detected
+				stats->phase(BuildStats::PHASE_CHECK, t);
+				stats->failure(BuildStats::PARALLEL);
+				runagain = true;
+				continue;
+			}
+
 			CoreFinder coreFinder(g, core);
 			bfs.visitAll(g, coreFinder);
+			stats->phase(BuildStats::PHASE_CHECK, t);
 
-//			std::cout << coreFinder.nonCoreEdgesTimes2 << std::endl;
 			size_t coreEdgesTimes2 = 2*map.size() - coreFinder.nonCoreEdgesTimes2;
 			if (coreEdgesTimes2 > map.size()) {
-//				std::cout << "core is too big" << std::endl;
+				stats->failure(BuildStats::CORE_TOO_LARGE);
+				stats->core(coreEdgesTimes2 / 2);
 				runagain = true;
 				continue;
 			}
 
+			t = stats->now();
 			CoreAssigner coreAssigner(g, core);
 			bfs.visitAll(g, coreAssigner);
+			stats->phase(BuildStats::PHASE_ASSIGN, t);
 
+			stats->endRun(true);
 			return true;
 		}
+		stats->endRun(false);
 		return false;
 	}
 };
@@ -3,24 +3,109 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <numeric>
+#include <memory>
 
 #include "randtools.hpp"
 #include "hashtools.hpp"
+#include "rank.hpp"
+#include "buildcontext.hpp"
+#include "buildstats.hpp"
 #include "algo.hpp"
 
 class AlgoCHD {
 private:
 	using string = std::string;
 	using size_t = std::size_t;
-	using vectorb = std::vector<bool>;
-	using vectors = std::vector<size_t>;
-	using vectorss = std::vector<vectors>;
-	using vectorstr = std::vector<string>;
+	using vectorb = std::pmr::vector<bool>;
+	using vectoru = std::pmr::vector<uint32_t>;
+	using vectorstr = std::pmr::vector<const string *>;
+
+	unsigned folding = FOLD_NONE;
+	size_t depth = 32;
+	RankDirectory::Overhead rankOverhead = RankDirectory::OVERHEAD_6;
+	BuildContext context;
+	BuildContext *ctx = &context;
+	BuildStats noStats { false };
+	BuildStats *stats = &noStats;
+	TrialSeeds trialSeeds;
+
+	// the generated function: hf[0] selects the bucket, hf[1] the index with
+	// the seed of the bucket (pre[1] must be stateless, only the seeds of
+	// hf[1] are saved)
+	std::unique_ptr<HashFuncs<2>> funcs;
+	uint32_t n = 0;
+	FastMod fm;
+	FastMod fmBuckets;
+	std::vector<uint32_t> seeds;
+	RankDirectory rank;
 
 public:
+	static constexpr size_t BATCH = 256;
+
+	/**
+	 * Set the character folding (FOLD_* flags) applied by the hash functions.
+	 */
+	void setFolding(unsigned flags) {
+		folding = flags;
+	}
+
+	/**
+	 * Set the space overhead of the rank directory used to make the
+	 * function minimal.
+	 */
+	void setRankOverhead(RankDirectory::Overhead o) {
+		rankOverhead = o;
+	}
+
+	/**
+	 * Set the number of keys whose bucket seeds are prefetched together
+	 * by lookupBatch, at most BATCH.
+	 */
+	void setPrefetchDepth(size_t d) {
+		if (d == 0 || d > BATCH) {
+			throw std::runtime_error("invalid prefetch depth");
+		}
+		depth = d;
+	}
+
+	/**
+	 * Take the scratch memory of builds from a context that may be
+	 * shared with other algorithms, instead of an own one.
+	 */
+	void setBuildContext(BuildContext &c) {
+		ctx = &c;
+	}
+
+	BuildContext &getBuildContext() {
+		return *ctx;
+	}
+
+	/**
+	 * Report the trials, failures and phase times of runs to s.
+	 */
+	void setStats(BuildStats &s) {
+		stats = &s;
+	}
+
+	/**
+	 * Seeds of the trials, for reproducible builds.
+	 */
+	TrialSeeds &getTrialSeeds() {
+		return trialSeeds;
+	}
+
 	double factor_init() {
 		return 1.02;
 	}
+	/**
+	 * Load factor n/m below which runs (almost) never succeed.
+	 */
+	double factor_min(size_t m) {
+		(void)m;
+		// at least one slot per key
+		return 1.0;
+	}
 	double factor_inc() {
 		return 1.05;
 	}
@@ -29,46 +114,80 @@ public:
 			size_t maxlen, uint32_t n, size_t trials) {
 		(void)maxlen;
 
+		this->n = 0;
+		ctx->reset();
+		stats->beginRun(map.size(), n);
+		Trace::Scope scope("AlgoCHD::run", "n", n);
 		RandRange rs32Bit(randgen, 0, UINT32_MAX);
+		funcs = std::make_unique<HashFuncs<2>>(folding, rs32Bit);
+		auto &pre1 = funcs->pre[0];
+		auto &pre2 = funcs->pre[1];
+		auto &hf1 = funcs->hf[0];
+		auto &hf2 = funcs->hf[1];
 
-		PreNone pre1;
-		PreNone pre2;
-		HashJenkinsOneAtATime hf1(pre1, rs32Bit);
-		HashJenkinsOneAtATime hf2(pre2, rs32Bit);
-
-
-		vectorstr keys;
+		vectorstr keys(ctx);
+		keys.reserve(map.size());
 		for (auto &x : map) {
-			keys.push_back(x.first);
+			keys.push_back(&x.first);
 		}
 
-		vectorb taken;
-		vectorss buckets;
-		vectors buckethashes;
+		// the buckets in compressed sparse row form: the keys of bucket b
+		// are bucketKeys[bucketStart[b]] to bucketKeys[bucketStart[b+1]-1]
+		vectorb taken(ctx);
+		vectoru keyBucket(keys.size(), 0, ctx);
+		vectoru bucketStart(ctx);
+		vectoru bucketKeys(keys.size(), 0, ctx);
+		vectoru order(ctx);
 
 		bool runagain = true;
 		for (size_t i=0; runagain && i<trials; i++) {
+			trialSeeds.reseed(randgen, n, i);
 			pre1.randomize();
 			hf1.randomize();
+			stats->trial();
 
+			auto t = stats->now();
 			uint32_t mod = 313;
-			buckets.assign(mod, vectors());
 
-			// map to buckets
+			// map to buckets, count, and place keys in order of their index
+			bucketStart.assign(mod + 1, 0);
 			for (size_t i = 0; i<keys.size(); i++) {
-				auto &key = keys[i];
-				uint32_t h1 = hf1.hash(key) % mod;
-				buckets[h1].push_back(i);
+				keyBucket[i] = hf1.hash(*keys[i]) % mod;
+				bucketStart[keyBucket[i] + 1]++;
 			}
-			std::sort(buckets.begin(), buckets.end(), [](vectors &a, vectors & b) {
-					return a.size() > b.size();
+			for (uint32_t b = 0; b<mod; b++) {
+				bucketStart[b + 1] += bucketStart[b];
+			}
+			for (size_t i = 0; i<keys.size(); i++) {
+				bucketKeys[bucketStart[keyBucket[i]]++] = (uint32_t)i;
+			}
+			for (uint32_t b = mod; b>0; b--) {
+				bucketStart[b] = bucketStart[b - 1];
+			}
+			bucketStart[0] = 0;
+			auto bucketSize = [&bucketStart](uint32_t b) {
+				return bucketStart[b + 1] - bucketStart[b];
+			};
+			// process big buckets first, equal ones in order of their index
+			order.resize(mod);
+			std::iota(order.begin(), order.end(), 0);
+			std::sort(order.begin(), order.end(), [&bucketSize](uint32_t a, uint32_t b) {
+					uint32_t sa = bucketSize(a);
+					uint32_t sb = bucketSize(b);
+					return sa > sb || (sa == sb && a < b);
 				});
+			seeds.assign(mod, 0);
+
+			stats->phase(BuildStats::PHASE_HASH, t);
 
 			// reset boolean markers
+			t = stats->now();
 			taken.assign(n, false);
 
 			runagain = false;			
-			for (auto &bucket : buckets) {
+			for (uint32_t bi : order) {
+				const uint32_t *bucket = bucketKeys.data() + bucketStart[bi];
+				const uint32_t *bucketEnd = bucketKeys.data() + bucketStart[bi + 1];
 				// std::cout << "bucket" << std::endl;
 
 				// find non-colliding hash function
@@ -76,42 +195,104 @@ public:
 				while (trials2 > 0) {
 					pre2.randomize();
 					hf2.randomize();
+					// keys of the same bucket must not collide either,
+					// so mark values as taken right away
 					bool collision = false;
-					for (auto ki : bucket) {
-						string &key = keys[ki];
+					size_t placed = 0;
+					for (const uint32_t *ki = bucket; ki != bucketEnd; ki++) {
+						const string &key = *keys[*ki];
 						uint32_t h2 = hf2.hash(key) % n;
 						// std::cout << "  " << key << " " << h2 << std::endl;
 						if (taken[h2]) {
 							collision = true;
 							break;
 						}
+						taken[h2] = true;
+						placed++;
 					}
 					if (!collision) {
 						break;
 					}
+					// undo
+					for (size_t j=0; j<placed; j++) {
+						const string &key = *keys[bucket[j]];
+						uint32_t h2 = hf2.hash(key) % n;
+						taken[h2] = false;
+					}
 					trials2--;
 				}
 				if (trials2 <= 0) {
-					// std::cout << "failed at bucket " << bucket.size() << std::endl;
+					stats->failure(BuildStats::BUCKET_EXHAUSTED);
 					runagain = true;
 					break;
 				}
-				for (auto ki : bucket) {
-					string &key = keys[ki];
-					uint32_t h2 = hf2.hash(key) % n;
-					taken[h2] = true;
-				}
+				seeds[bi] = hf2.getSeed();
 			}
 
+			stats->phase(BuildStats::PHASE_ASSIGN, t);
+
 			if (runagain) {
 				continue;
 			}
 
+			// compress [0,n) to [0,m)
+			t = stats->now();
+			rank.build(taken, rankOverhead);
+			stats->phase(BuildStats::PHASE_COMPRESS, t);
 
+			this->n = n;
+			fm = FastMod(n);
+			fmBuckets = FastMod(mod);
+			stats->endRun(true);
 			return true;
 		}
+		stats->endRun(false);
 		return false;
 	}
+
+	/**
+	 * Size of the function found by the last successful run.
+	 */
+	size_t bytes() const {
+		return seeds.size() * sizeof(uint32_t) + rank.bytes();
+	}
+
+	/**
+	 * Evaluate the function found by the last successful run.
+	 * @return value in [0,m)
+	 */
+	uint32_t lookup(const string &key) {
+		uint32_t b = fmBuckets.mod(funcs->hf[0].hash(key));
+		return rank.rank(fm.mod(funcs->hf[1].hashWithSeed(key, seeds[b])));
+	}
+
+	/**
+	 * Evaluate the function for several keys, out[i] receives lookup(keys[i]).
+	 * Blocks of keys are hashed first and their bucket seeds are prefetched
+	 * before any of them is used. The same is done for the rank directory.
+	 */
+	void lookupBatch(const string *keys, size_t count, uint32_t *out) {
+		uint32_t h[BATCH];
+		for (size_t b=0; b<count; b+=depth) {
+			size_t k = std::min(depth, count - b);
+			funcs->hf[0].hashBatch(keys + b, k, h);
+			for (size_t i=0; i<k; i++) {
+				h[i] = fmBuckets.mod(h[i]);
+				__builtin_prefetch(&seeds[h[i]]);
+			}
+			for (size_t i=0; i<k; i++) {
+				h[i] = seeds[h[i]];
+			}
+			funcs->hf[1].hashBatchWithSeeds(keys + b, k, h, h);
+			for (size_t i=0; i<k; i++) {
+				out[b+i] = fm.mod(h[i]);
+				__builtin_prefetch(rank.address(out[b+i]));
+			}
+			for (size_t i=0; i<k; i++) {
+				out[b+i] = rank.rank(out[b+i]);
+			}
+		}
+	}
 };
 
 
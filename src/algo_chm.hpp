@@ -2,31 +2,47 @@
 
 #include <vector>
 #include <string>
+#include <memory>
+#include <algorithm>
 
 #include "randtools.hpp"
+#include "bitarray.hpp"
+#include "hashtools.hpp"
 #include "unionfind.hpp"
+#include "concurrentunionfind.hpp"
 #include "graph.hpp"
 #include "bfs.hpp"
+#include "buildcontext.hpp"
+#include "buildstats.hpp"
 #include "algo.hpp"
 
 /* Idea:
  * keep track of connected components with union find detect cycles
+ * (with threads, a ConcurrentUnionFind checks slices of the keys in
+ * parallel)
+ *
+ * The union find, graph, BFS and the tables of the preprocessors take
+ * their memory from a BuildContext, so repeated runs allocate nothing
+ * but the generated function.
+ *
+ * The node values are bit-packed, each takes as many bits as the
+ * largest value assigned to a key (ceil(log2 m) for array indices).
  *
  * Space for 10000 words:
- * 18743 * 2 = 37486 bytes
+ * 18743 * 14/8 = 32800.25 bytes
  */
 
 class AlgoCHM {
 private:
 	using string = std::string;
 	using edge_t = Graph::edge_t;
-	using vector = std::vector<edge_t>;
+	using vector = std::pmr::vector<edge_t>;
 
 	class ValueAssigner {
 	public:
 		vector values;
 
-		ValueAssigner(size_t n) : values(n, 0) {
+		ValueAssigner(size_t n, std::pmr::memory_resource *mr) : values(n, 0, mr) {
 			// nothing
 		}
 
@@ -48,10 +64,97 @@ private:
 		}
 	};
 
+	// hash functions of the generated function, seeds and values in [0,n)
+	using funcs_t = HashFuncs<2, HashMultSum, PreMult>;
+
+	unsigned folding = FOLD_NONE;
+	size_t depth = 32;
+	unsigned threads = 0;
+	BuildContext context;
+	BuildContext *ctx = &context;
+	BuildStats noStats { false };
+	BuildStats *stats = &noStats;
+	TrialSeeds trialSeeds;
+
+	// the generated function
+	std::unique_ptr<funcs_t> funcs;
+	uint32_t n = 0;
+	size_t maxlen = 0;
+	FastMod fm;
+	PackedArray values;
+
+	void checkLength(const string &key) const {
+		if (key.length() > maxlen) {
+			throw std::runtime_error("key is longer than all keys in the set");
+		}
+	}
+
 public:
+	static constexpr size_t BATCH = 256;
+
+	/**
+	 * Set the character folding (FOLD_* flags) applied by the hash functions.
+	 */
+	void setFolding(unsigned flags) {
+		folding = flags;
+	}
+
+	/**
+	 * Set the number of keys whose node values are prefetched together
+	 * by lookupBatch, at most BATCH.
+	 */
+	void setPrefetchDepth(size_t d) {
+		if (d == 0 || d > BATCH) {
+			throw std::runtime_error("invalid prefetch depth");
+		}
+		depth = d;
+	}
+
+	/**
+	 * Set the number of threads that check the graph for cycles,
+	 * 0 (the default) for the sequential union find.
+	 */
+	void setThreads(unsigned t) {
+		threads = t;
+	}
+
+	/**
+	 * Take the scratch memory of builds from a context that may be
+	 * shared with other algorithms, instead of an own one.
+	 */
+	void setBuildContext(BuildContext &c) {
+		ctx = &c;
+	}
+
+	BuildContext &getBuildContext() {
+		return *ctx;
+	}
+
+	/**
+	 * Report the trials, failures and phase times of runs to s.
+	 */
+	void setStats(BuildStats &s) {
+		stats = &s;
+	}
+
+	/**
+	 * Seeds of the trials, for reproducible builds.
+	 */
+	TrialSeeds &getTrialSeeds() {
+		return trialSeeds;
+	}
+
 	double factor_init() {
 		return 1.7;
 	}
+	/**
+	 * Load factor n/m below which runs (almost) never succeed.
+	 */
+	double factor_min(size_t m) {
+		(void)m;
+		// the graph is acyclic with probability sqrt(1 - (2m/n)^2)
+		return 2.0;
+	}
 	double factor_inc() {
 		return 1.05;
 	}
@@ -73,36 +176,42 @@ public:
 //			}
 //		}
 
+		this->n = 0;
+		ctx->reset();
+		stats->beginRun(map.size(), n);
+		Trace::Scope scope("AlgoCHM::run", "n", n);
 		RandConst rsC0(0);
 		RandConst rsC1(1);
+		RandRange rs0_n(randgen, 0, n-1);
+		RandRange rs1_n(randgen, 1, n-1);
+		funcs = std::make_unique<funcs_t>(folding, [&](Preprocessor &p, unsigned k) {
+			RandSource &rseed = (k == 0) ? (RandSource &)rsC0 : rs0_n;
+			return HashMultSum(p, rseed, rsC1);
+		}, maxlen, rs1_n, ctx);
 //		RandConst rsC33(33);
 //		RandConst rsC5381(5381);
 //		RandRange rs0_256(randgen, 0, 255);
-		RandRange rs0_n(randgen, 0, n-1);
-		RandRange rs1_n(randgen, 1, n-1);
 //		RandPrime rp1_n(randgen, 1, n-1);
 //		RandList  rsFactor(randgen, rsFactorList);
 
-		PreMult pre1(maxlen, rs1_n);
-		PreMult pre2(maxlen, rs1_n);
-		HashMultSum hf1(pre1, rsC0, rsC1);
-		HashMultSum hf2(pre2, rs0_n, rsC1);
+		auto &hf1 = funcs->hf[0];
+		auto &hf2 = funcs->hf[1];
 
 //		PreXOR pre1(maxlen, rs0_256);
 //		PreXOR pre2(maxlen, rs0_256);
 //		HashMultSum hf1(pre1, rs1_n, rsFactor);
 //		HashMultSum hf2(pre2, rs1_n, rsFactor);
 
-		{
-			UnionFind uf(n);
+		if (threads == 0) {
+			UnionFind uf(n, ctx);
 			bool runagain = true;
 			for (size_t i=0; runagain && i<trials; i++) {
-				pre1.randomize();
-				pre2.randomize();
-				hf1.randomize();
-				hf2.randomize();
+				trialSeeds.reseed(randgen, n, i);
+				funcs->randomize();
 				uf.clear();
+				stats->trial();
 
+				auto t = stats->now();
 				runagain = false;
 				for (auto &x : map) {
 					const string &key = x.first;
@@ -111,33 +220,138 @@ public:
 					bool circle = uf.doUnion(h1, h2);
 					if (circle) {
 						// cycle, parallel, or loop detected
+						stats->failure(h1 == h2 ? BuildStats::LOOP : BuildStats::CYCLE);
 						runagain = true;
 						break;
 					}
 				}
+				stats->phase(BuildStats::PHASE_CHECK, t);
+				stats->unionFindDepth(uf.maxDepth());
+			}
+			if (runagain) {
+				funcs.reset();
+				stats->endRun(false);
+				return false;
+			}
+		} else {
+			ConcurrentUnionFind uf(n, ctx);
+			std::pmr::vector<const string *> keys(ctx);
+			keys.reserve(map.size());
+			for (auto &x : map) {
+				keys.push_back(&x.first);
+			}
+			bool runagain = true;
+			for (size_t i=0; runagain && i<trials; i++) {
+				trialSeeds.reseed(randgen, n, i);
+				funcs->randomize();
+				uf.clear(threads);
+				stats->trial();
+
+				// cycle, parallel, or loop detected
+				auto t = stats->now();
+				runagain = uf.findCycle(threads, keys.size(),
+						[&](size_t k, size_t &a, size_t &b) {
+					a = hf1.hash(*keys[k]) % n;
+					b = hf2.hash(*keys[k]) % n;
+				});
+				stats->phase(BuildStats::PHASE_CHECK, t);
+				if (runagain) {
+					stats->failure(BuildStats::CYCLE);
+				}
 			}
 			if (runagain) {
+				funcs.reset();
+				stats->endRun(false);
 				return false;
 			}
 		}
 
-		Graph g(n);
+		auto t = stats->now();
+		Graph g(n, ctx);
 		for (auto &x : map) {
 			const string &key = x.first;
 			uint32_t h1 = hf1.hash(key) % n;
 			uint32_t h2 = hf2.hash(key) % n;
 			g.addEdge(h1, h2, x.second);
 		}
+		g.build();
 
-		BFS bfs;
-		ValueAssigner vals(n);
+		BFS bfs(ctx);
+		ValueAssigner vals(n, ctx);
 		bfs.visitAll(g, vals);
 
-		//TODO save working coefficients
-		//TODO check!
+		edge_t maxval = 0;
+		for (auto &x : map) {
+			maxval = std::max(maxval, x.second);
+		}
+		// XORs of values never need more bits than the values themselves
+		values.assign(n, PackedArray::bitsFor(maxval));
+		for (size_t i=0; i<n; i++) {
+			values.set(i, vals.values[i]);
+		}
+		stats->phase(BuildStats::PHASE_ASSIGN, t);
+
+		this->n = n;
+		this->maxlen = maxlen;
+		fm = FastMod(n);
+		// the tables of the preprocessors outlive the BuildContext
+		funcs->moveTo(std::pmr::new_delete_resource());
 
+		// sanity check
+		for (auto &x : map) {
+			if (lookup(x.first) != x.second) {
+				throw std::runtime_error("sanity check failed");
+			}
+		}
+		stats->endRun(true);
 		return true;
 	}
+
+	/**
+	 * Size of the node values of the last successful run (without the
+	 * tables of the hash functions).
+	 */
+	size_t bytes() const {
+		return values.bytes();
+	}
+
+	/**
+	 * Evaluate the function found by the last successful run.
+	 * @return the value assigned to the key
+	 */
+	edge_t lookup(const string &key) {
+		checkLength(key);
+		uint32_t h1 = fm.mod(funcs->hf[0].hash(key));
+		uint32_t h2 = fm.mod(funcs->hf[1].hash(key));
+		return values.get(h1) ^ values.get(h2);
+	}
+
+	/**
+	 * Evaluate the function for several keys, out[i] receives lookup(keys[i]).
+	 * Blocks of keys are hashed first and their node values are prefetched
+	 * before any of them is resolved.
+	 */
+	void lookupBatch(const string *keys, size_t count, edge_t *out) {
+		uint32_t h1[BATCH];
+		uint32_t h2[BATCH];
+		for (size_t b=0; b<count; b+=depth) {
+			size_t k = std::min(depth, count - b);
+			for (size_t i=0; i<k; i++) {
+				checkLength(keys[b+i]);
+			}
+			funcs->hf[0].hashBatch(keys + b, k, h1);
+			funcs->hf[1].hashBatch(keys + b, k, h2);
+			for (size_t i=0; i<k; i++) {
+				h1[i] = fm.mod(h1[i]);
+				h2[i] = fm.mod(h2[i]);
+				__builtin_prefetch(values.address(h1[i]));
+				__builtin_prefetch(values.address(h2[i]));
+			}
+			for (size_t i=0; i<k; i++) {
+				out[b+i] = values.get(h1[i]) ^ values.get(h2[i]);
+			}
+		}
+	}
 };
 
 
@@ -1,22 +1,32 @@
 #pragma once
 
-#include <tuple>
-#include <deque>
+#include <cstdint>
 #include <vector>
+#include <memory_resource>
 
 #include "graph.hpp"
 
+/**
+ * Breadth first search over all nodes of a Graph.
+ *
+ * Each node is queued at most once, so the queue is a flat array of
+ * n entries that is reused for every tree (and every graph).
+ */
 class BFS {
 public:
 	using size_t = std::size_t;
 
 private:
-	using qe_t = std::pair<size_t, size_t>;
-	std::vector<bool> done;
-	std::deque<qe_t> q;
+	struct qe_t {
+		uint32_t node;
+		uint32_t parent;
+	};
+	std::pmr::vector<uint8_t> done;
+	std::pmr::vector<qe_t> q;
 
 	void clearDone(size_t n) {
-		done.assign(n, false);
+		done.assign(n, 0);
+		q.resize(n);
 	}
 
 	template <class G, class L>
@@ -29,12 +39,13 @@ private:
 		}
 		// root has no parent, so use invalid index n
 		size_t p = g.getN();
-		done[s] = true;
-		q.clear();
+		done[s] = 1;
+		size_t head = 0;
+		size_t tail = 0;
 		while (true) {
 			for (auto &x : g.adjList(s)) {
 				size_t neighbor = x.first;
-				const Graph::edge_t &edge_val = x.second;
+				const Graph::edge_t &edge_val = g.value(x.edge);
 				if (neighbor == p) {
 					// ignore edge to parent
 					continue;
@@ -44,20 +55,26 @@ private:
 				} else {
 					bool cont = listener.normalEdge(s, neighbor, edge_val);
 					if (cont) {
-						q.push_back(qe_t(neighbor, s));
-						done[neighbor] = true;
+						q[tail++] = qe_t { (uint32_t)neighbor, (uint32_t)s };
+						done[neighbor] = 1;
 					}
 				}
 			}
-			if (q.empty()) {
+			if (head == tail) {
 				break;
 			}
-			std::tie(s, p) = q.front();
-			q.pop_front();
+			s = q[head].node;
+			p = q[head].parent;
+			head++;
 		}
 	}
 
 public:
+	BFS(std::pmr::memory_resource *mr = std::pmr::get_default_resource()) :
+			done(mr), q(mr) {
+		// nothing
+	}
+
 	template <class G, class L>
 	void visitAll(const G &g, L &listener) {
 		size_t n = g.getN();
@@ -68,4 +85,3 @@ public:
 	}
 
 };
-
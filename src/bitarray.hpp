@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <stdexcept>
+
+/**
+ * An array of unsigned integers with a fixed bit width.
+ *
+ * Values are read and written with unaligned 64 bit accesses at byte
+ * granularity, so a value of up to 57 bits never needs more than one
+ * load. Wider values (up to 64 bits) that do not fit into the 8 bytes
+ * from their first byte take their top bits from the ninth. One word of
+ * padding at the end keeps the accesses in bounds.
+ */
+class PackedArray {
+public:
+	using size_t = std::size_t;
+	using uint64_t = std::uint64_t;
+
+	static constexpr unsigned MAX_WIDTH = 64;
+
+private:
+	size_t n = 0;
+	unsigned width = 0;
+	uint64_t mask = 0;
+	std::vector<uint64_t> words;
+
+	void checkIndex(size_t i) const {
+		if (i >= n) {
+			throw std::runtime_error("invalid index");
+		}
+	}
+
+public:
+	PackedArray() {
+		// nothing
+	}
+
+	PackedArray(size_t n, unsigned width) {
+		assign(n, width);
+	}
+
+	/**
+	 * Number of bits required to store values in [0,maxval].
+	 */
+	static unsigned bitsFor(uint64_t maxval) {
+		unsigned r = 0;
+		while (maxval > 0) {
+			maxval >>= 1;
+			r++;
+		}
+		return r;
+	}
+
+	/**
+	 * Resize to n values of the given width and set all of them to zero.
+	 */
+	void assign(size_t n, unsigned width) {
+		if (width > MAX_WIDTH) {
+			throw std::runtime_error("width too large");
+		}
+		this->n = n;
+		this->width = width;
+		mask = (width > 0) ? (~(uint64_t)0 >> (64 - width)) : 0;
+		words.assign((n * width + 63) / 64 + 1, 0);
+	}
+
+	size_t size() const {
+		return n;
+	}
+
+	unsigned getWidth() const {
+		return width;
+	}
+
+	/**
+	 * Size of the array in bytes (including padding).
+	 */
+	size_t bytes() const {
+		return words.size() * sizeof(uint64_t);
+	}
+
+	/**
+	 * Address of the byte containing the first bit of value i,
+	 * e.g. for prefetching.
+	 */
+	const void *address(size_t i) const {
+		return (const char *)words.data() + i * width / 8;
+	}
+
+	uint64_t get(size_t i) const {
+		size_t bit = i * width;
+		const unsigned char *p = (const unsigned char *)words.data() + bit / 8;
+		unsigned shift = (unsigned)(bit % 8);
+		uint64_t x;
+		std::memcpy(&x, p, sizeof(x));
+		x >>= shift;
+		if (shift + width > 64) {
+			// only with more than 57 bits
+			x |= (uint64_t)p[8] << (64 - shift);
+		}
+		return x & mask;
+	}
+
+	void set(size_t i, uint64_t v) {
+		checkIndex(i);
+		if ((v & ~mask) != 0) {
+			throw std::runtime_error("value too large");
+		}
+		size_t bit = i * width;
+		unsigned char *p = (unsigned char *)words.data() + bit / 8;
+		unsigned shift = (unsigned)(bit % 8);
+		uint64_t x;
+		std::memcpy(&x, p, sizeof(x));
+		x &= ~(mask << shift);
+		x |= v << shift;
+		std::memcpy(p, &x, sizeof(x));
+		if (shift + width > 64) {
+			unsigned high = shift + width - 64;
+			p[8] = (unsigned char)((p[8] & ~((1u << high) - 1)) | (v >> (64 - shift)));
+		}
+	}
+};
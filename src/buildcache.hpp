@@ -0,0 +1,202 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
+#include <system_error>
+#include <atomic>
+#include <stdexcept>
+
+#include <unistd.h>
+
+#include <json/json.h>
+
+#include "algo.hpp"
+#include "randtools.hpp"
+#include "loadsearch.hpp"
+#include "trace.hpp"
+
+/**
+ * On-disk cache of the n, seed and trial that built a function (see
+ * TrialSeeds), keyed by a digest of the key set (keys and values), the
+ * engine and its parameters. An unchanged key set is built again with a
+ * single trial instead of a search.
+ *
+ * Each entry is a small JSON file in the cache directory, named by the
+ * digest. It is written to a temporary file of its own and renamed, so
+ * concurrent builds never read half an entry. If the cached seed fails
+ * (for example after a change of the hash functions), the function is
+ * searched for as usual and the entry replaced.
+ */
+class BuildCache {
+public:
+	using size_t = std::size_t;
+	using uint32_t = std::uint32_t;
+	using uint64_t = std::uint64_t;
+	using string = std::string;
+
+	// part of every digest, increment when entries become invalid
+	static constexpr uint64_t FORMAT = 2;
+
+private:
+	std::filesystem::path dir;
+	bool hit = false;
+
+	static uint64_t hashBytes(const string &s, uint64_t h) {
+		// FNV-1a
+		for (unsigned char c : s) {
+			h = (h ^ c) * 0x100000001B3ull;
+		}
+		return h;
+	}
+
+	std::filesystem::path file(const string &digest) const {
+		return dir / (digest + ".json");
+	}
+
+public:
+	/**
+	 * @param dir directory of the entries, created when needed
+	 */
+	BuildCache(const string &dir) : dir(dir) {
+		// nothing
+	}
+
+	/**
+	 * Digest of map and params, independent of the order of the map.
+	 * @param params the engine and everything that changes its output,
+	 * for example "BDZ3 folding=0 fuse=1"
+	 */
+	static string digest(const map_t &map, const string &params) {
+		// sum of the mixed hashes of the entries, the order does not matter
+		uint64_t sum = 0;
+		for (auto &x : map) {
+			uint64_t h = hashBytes(x.first, 0xCBF29CE484222325ull);
+			sum += mixSeed(h ^ mixSeed(x.second));
+		}
+		uint64_t a = mixSeed(sum ^ mixSeed(map.size()));
+		uint64_t b = mixSeed(hashBytes(params, 0xCBF29CE484222325ull) + FORMAT);
+		std::ostringstream out;
+		out << std::hex << std::setfill('0') << std::setw(16) << a
+				<< std::setw(16) << mixSeed(a ^ b);
+		return out.str();
+	}
+
+	/**
+	 * Read the entry of digest.
+	 * @return whether there is one, a damaged entry counts as missing
+	 */
+	bool get(const string &digest, uint32_t &n, uint64_t &seed, size_t &trial) const {
+		std::ifstream in(file(digest));
+		if (in.fail()) {
+			return false;
+		}
+		Json::Value root;
+		Json::CharReaderBuilder builder;
+		string errors;
+		if (!Json::parseFromStream(builder, in, &root, &errors)
+				|| !root.isObject() || root["digest"].asString() != digest
+				|| !root["n"].isUInt() || !root["seed"].isString()
+				|| !root["trial"].isUInt()) {
+			// damaged, it will be replaced
+			return false;
+		}
+		// as a string, JSON numbers are doubles for some readers
+		string hex = root["seed"].asString();
+		size_t end = 0;
+		uint64_t s;
+		try {
+			s = std::stoull(hex, &end, 16);
+		} catch (std::logic_error &) {
+			// invalid_argument or out_of_range
+			return false;
+		}
+		if (end != hex.length()) {
+			return false;
+		}
+		n = root["n"].asUInt();
+		seed = s;
+		trial = root["trial"].asUInt();
+		return true;
+	}
+
+	void put(const string &digest, uint32_t n, uint64_t seed, size_t trial) const {
+		std::filesystem::create_directories(dir);
+		Json::Value root(Json::objectValue);
+		root["digest"] = digest;
+		root["n"] = n;
+		std::ostringstream s;
+		s << std::hex << seed;
+		root["seed"] = s.str();
+		root["trial"] = (Json::UInt)trial;
+		// unique among processes and threads, in the same directory so that
+		// rename() replaces the entry atomically
+		static std::atomic<unsigned> counter { 0 };
+		std::filesystem::path tmp = file(digest);
+		tmp += "." + std::to_string(getpid()) + "." + std::to_string(counter++) + ".tmp";
+		{
+			std::ofstream out(tmp);
+			Json::StreamWriterBuilder builder;
+			builder["indentation"] = "\t";
+			out << Json::writeString(builder, root) << std::endl;
+			out.close();
+			if (out.fail()) {
+				std::error_code ec;
+				std::filesystem::remove(tmp, ec);
+				throw std::runtime_error("failed to write build cache entry");
+			}
+		}
+		std::error_code ec;
+		std::filesystem::rename(tmp, file(digest), ec);
+		if (ec) {
+			std::filesystem::remove(tmp, ec);
+			throw std::runtime_error("failed to rename build cache entry");
+		}
+	}
+
+	/**
+	 * Build the function of map with algo: with the cached n, seed and
+	 * trial if they exist and succeed, otherwise with a search whose
+	 * result is cached. The TrialSeeds of algo keep the seed afterwards.
+	 * @param params see digest()
+	 * @param seed seed of the search, for reproducible builds
+	 * @return n
+	 */
+	template <class A>
+	uint32_t build(A &algo, const map_t &map, size_t maxlen, const string &params,
+			LoadSearch &search, uint64_t seed) {
+		Trace::Scope scope("build cache");
+		string d = digest(map, params);
+		TrialSeeds &seeds = algo.getTrialSeeds();
+		uint32_t n;
+		uint64_t s;
+		size_t trial;
+		hit = false;
+		if (get(d, n, s, trial)) {
+			// repeat the successful trial alone
+			randgen_t randgen(s);
+			seeds.setSeed(s);
+			seeds.setFirstTrial(trial);
+			hit = algo.run(randgen, map, maxlen, n, 1);
+			seeds.setFirstTrial(0);
+			if (hit) {
+				return n;
+			}
+		}
+		randgen_t randgen(seed);
+		seeds.setSeed(seed);
+		n = search.search(algo, randgen, map, maxlen);
+		put(d, n, seed, seeds.getLastTrial());
+		return n;
+	}
+
+	/**
+	 * Whether the last build() used a cached entry.
+	 */
+	bool isHit() const {
+		return hit;
+	}
+};
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <memory_resource>
+
+/**
+ * Scratch memory of builds: a grow-only arena that the algorithms
+ * allocate their graphs, union finds, stacks, and bit sets from.
+ *
+ * Memory is handed out from large chunks and never returned until
+ * reset(), which makes all of it available again. If a build needed
+ * more than one chunk, reset() replaces them by a single chunk of the
+ * combined size, so that repeating a build of the same size (another
+ * trial, or the next candidate n) allocates nothing.
+ *
+ * Containers use it as a std::pmr::memory_resource. Allocation is
+ * thread-safe, but reset() must not run while a build uses the context.
+ */
+class BuildContext : public std::pmr::memory_resource {
+public:
+	using size_t = std::size_t;
+
+private:
+	static constexpr size_t LINE = 64;
+	static constexpr size_t MIN_CHUNK = (size_t)1 << 20;
+
+	struct Chunk {
+		char *p;
+		size_t size;
+	};
+
+	std::mutex mutex;
+	std::vector<Chunk> chunks;
+	// chunk that is currently used and bytes used in it
+	size_t cur = 0;
+	size_t used = 0;
+	// bytes handed out since the last reset
+	size_t inUse = 0;
+	size_t highWater = 0;
+
+	static size_t roundUp(size_t x, size_t a) {
+		return (x + a - 1) / a * a;
+	}
+
+	void addChunk(size_t size) {
+		size = roundUp(size, LINE);
+		char *p = (char *)std::aligned_alloc(LINE, size);
+		if (!p) {
+			throw std::bad_alloc();
+		}
+		chunks.push_back(Chunk { p, size });
+	}
+
+	void freeChunks() {
+		for (auto &c : chunks) {
+			std::free(c.p);
+		}
+		chunks.clear();
+	}
+
+protected:
+	void *do_allocate(size_t bytes, size_t alignment) override {
+		std::lock_guard<std::mutex> lock(mutex);
+		alignment = std::max(alignment, (size_t)alignof(std::max_align_t));
+		while (true) {
+			if (cur == chunks.size()) {
+				size_t last = chunks.empty() ? 0 : chunks.back().size;
+				addChunk(std::max({ bytes + alignment, 2 * last, MIN_CHUNK }));
+			}
+			size_t off = roundUp(used, alignment);
+			if (off + bytes <= chunks[cur].size) {
+				used = off + bytes;
+				inUse += bytes;
+				highWater = std::max(highWater, inUse);
+				return chunks[cur].p + off;
+			}
+			cur++;
+			used = 0;
+		}
+	}
+
+	void do_deallocate(void *p, size_t bytes, size_t alignment) override {
+		// memory is reused after reset()
+		(void)p;
+		(void)bytes;
+		(void)alignment;
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+		return this == &other;
+	}
+
+public:
+	BuildContext() {
+		// nothing
+	}
+
+	BuildContext(const BuildContext &) = delete;
+	BuildContext &operator=(const BuildContext &) = delete;
+
+	~BuildContext() {
+		freeChunks();
+	}
+
+	/**
+	 * Make all memory available again, the containers allocated from
+	 * the context must have been destroyed.
+	 */
+	void reset() {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (chunks.size() > 1) {
+			size_t total = capacity();
+			freeChunks();
+			addChunk(total);
+		}
+		cur = 0;
+		used = 0;
+		inUse = 0;
+	}
+
+	/**
+	 * Size of all chunks in bytes.
+	 */
+	size_t capacity() const {
+		size_t total = 0;
+		for (auto &c : chunks) {
+			total += c.size;
+		}
+		return total;
+	}
+
+	/**
+	 * Maximum number of bytes that were in use at the same time.
+	 */
+	size_t getHighWater() const {
+		return highWater;
+	}
+};
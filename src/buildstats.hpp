@@ -0,0 +1,296 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <ostream>
+#include <algorithm>
+
+#include <json/json.h>
+
+#include "trace.hpp"
+#include "perfcounters.hpp"
+
+/**
+ * Telemetry of builds: for each run of an algorithm (one candidate n)
+ * the number of trials and why they failed, the largest union find
+ * depth, and the size of the 2-core of failed peelings; over all runs
+ * the time per phase; for the result its size in bits per key.
+ *
+ * The algorithms report to a disabled instance unless setStats() was
+ * called, so the reporting calls cost a branch when nobody listens.
+ * Phases are also recorded in the active Trace, if any, and with
+ * setPerf() the hardware counters of each phase are summed up.
+ */
+class BuildStats {
+public:
+	using size_t = std::size_t;
+	using uint32_t = std::uint32_t;
+	using clock = std::chrono::steady_clock;
+
+	enum Failure {
+		// an edge with the same node twice
+		LOOP,
+		// two edges with the same nodes
+		PARALLEL,
+		// union find found a cycle (which may be a loop or parallel)
+		CYCLE,
+		// the hypergraph has a non-empty 2-core
+		NOT_PEELABLE,
+		// BMZ: the 2-core has too many edges
+		CORE_TOO_LARGE,
+		// CHD: no seed places a bucket
+		BUCKET_EXHAUSTED,
+		FAILURE_COUNT
+	};
+
+	enum Phase {
+		// computing the edges of the keys
+		PHASE_HASH,
+		// looking for cycles, loops or parallel edges
+		PHASE_CHECK,
+		PHASE_PEEL,
+		// assigning values to nodes (or seeds to buckets)
+		PHASE_ASSIGN,
+		// rank directory and value table
+		PHASE_COMPRESS,
+		PHASE_COUNT
+	};
+
+private:
+	struct Run {
+		uint32_t n;
+		size_t trials = 0;
+		bool success = false;
+		double seconds = 0;
+		size_t failures[FAILURE_COUNT] = {};
+		size_t ufDepth = 0;
+		size_t coreCount = 0;
+		size_t coreSum = 0;
+		size_t coreMax = 0;
+	};
+
+	static constexpr const char *FAILURE_NAMES[FAILURE_COUNT] = {
+		"loop", "parallel", "cycle", "not_peelable", "core_too_large", "bucket_exhausted"
+	};
+	static constexpr const char *PHASE_NAMES[PHASE_COUNT] = {
+		"hash", "check", "peel", "assign", "compress"
+	};
+
+	bool enabled;
+	std::string name;
+	size_t keys = 0;
+	size_t bytes = 0;
+	std::vector<Run> runs;
+	clock::time_point runStart;
+	double phases[PHASE_COUNT] = {};
+	size_t phaseCalls[PHASE_COUNT] = {};
+
+	// phases do not nest, so one snapshot at the start of the current
+	// phase is enough
+	const PerfCounters *perf = nullptr;
+	PerfCounters::Sample perfStart;
+	PerfCounters::Sample perfPhases[PHASE_COUNT];
+
+	Run &current() {
+		if (runs.empty()) {
+			runs.emplace_back();
+		}
+		return runs.back();
+	}
+
+public:
+	BuildStats(bool enabled = true) : enabled(enabled) {
+		// nothing
+	}
+
+	bool isEnabled() const {
+		return enabled;
+	}
+
+	void setName(const std::string &s) {
+		name = s;
+	}
+
+	/**
+	 * Count the hardware events of each phase with p.
+	 */
+	void setPerf(const PerfCounters &p) {
+		perf = &p;
+	}
+
+	void clear() {
+		keys = 0;
+		bytes = 0;
+		runs.clear();
+		std::fill(phases, phases + PHASE_COUNT, 0.0);
+		std::fill(phaseCalls, phaseCalls + PHASE_COUNT, 0);
+		std::fill(perfPhases, perfPhases + PHASE_COUNT, PerfCounters::Sample());
+	}
+
+	/**
+	 * The current time, or nothing if disabled and not tracing.
+	 */
+	clock::time_point now() {
+		if (enabled && perf) {
+			perfStart = perf->read();
+		}
+		return (enabled || Trace::active()) ? clock::now() : clock::time_point();
+	}
+
+	/**
+	 * A run of an algorithm for m keys and n starts.
+	 */
+	void beginRun(size_t m, uint32_t n) {
+		if (!enabled) {
+			return;
+		}
+		keys = m;
+		runs.emplace_back();
+		runs.back().n = n;
+		runStart = clock::now();
+	}
+
+	void endRun(bool success) {
+		if (!enabled) {
+			return;
+		}
+		current().success = success;
+		current().seconds = std::chrono::duration<double>(clock::now() - runStart).count();
+	}
+
+	void trial() {
+		if (enabled) {
+			current().trials++;
+		}
+	}
+
+	void failure(Failure f) {
+		if (enabled) {
+			current().failures[f]++;
+		}
+	}
+
+	/**
+	 * Edges left in the 2-core when peeling (or BMZ) failed.
+	 */
+	void core(size_t edges) {
+		if (!enabled) {
+			return;
+		}
+		Run &r = current();
+		r.coreCount++;
+		r.coreSum += edges;
+		r.coreMax = std::max(r.coreMax, edges);
+	}
+
+	/**
+	 * Longest find in the union find of a trial (UnionFind::maxDepth).
+	 */
+	void unionFindDepth(size_t d) {
+		if (enabled) {
+			current().ufDepth = std::max(current().ufDepth, d);
+		}
+	}
+
+	/**
+	 * Add the time since start to a phase.
+	 */
+	void phase(Phase p, clock::time_point start) {
+		if (start == clock::time_point()) {
+			return;
+		}
+		clock::time_point end = clock::now();
+		if (enabled) {
+			phases[p] += std::chrono::duration<double>(end - start).count();
+			phaseCalls[p]++;
+			if (perf) {
+				perfPhases[p] += perf->read() - perfStart;
+			}
+		}
+		if (Trace *trace = Trace::active()) {
+			trace->add(PHASE_NAMES[p], std::string(), start, end);
+		}
+	}
+
+	/**
+	 * Size of the generated function.
+	 */
+	void setBytes(size_t b) {
+		bytes = b;
+	}
+
+	size_t getTrials() const {
+		size_t t = 0;
+		for (auto &r : runs) {
+			t += r.trials;
+		}
+		return t;
+	}
+
+	Json::Value toJSON() const {
+		Json::Value root(Json::objectValue);
+		if (!name.empty()) {
+			root["algorithm"] = name;
+		}
+		root["keys"] = (Json::UInt64)keys;
+		root["trials"] = (Json::UInt64)getTrials();
+		Json::Value &rs = root["runs"] = Json::Value(Json::arrayValue);
+		for (auto &r : runs) {
+			Json::Value x(Json::objectValue);
+			x["n"] = r.n;
+			x["factor"] = keys ? r.n / (double)keys : 0.0;
+			x["trials"] = (Json::UInt64)r.trials;
+			x["success"] = r.success;
+			x["seconds"] = r.seconds;
+			Json::Value &f = x["failures"] = Json::Value(Json::objectValue);
+			for (unsigned i=0; i<FAILURE_COUNT; i++) {
+				if (r.failures[i] > 0) {
+					f[FAILURE_NAMES[i]] = (Json::UInt64)r.failures[i];
+				}
+			}
+			if (r.ufDepth > 0) {
+				x["union_find_depth"] = (Json::UInt64)r.ufDepth;
+			}
+			if (r.coreCount > 0) {
+				x["core_edges_mean"] = (double)r.coreSum / (double)r.coreCount;
+				x["core_edges_max"] = (Json::UInt64)r.coreMax;
+			}
+			rs.append(x);
+		}
+		Json::Value &ps = root["phases"] = Json::Value(Json::objectValue);
+		for (unsigned i=0; i<PHASE_COUNT; i++) {
+			ps[PHASE_NAMES[i]] = phases[i];
+		}
+		if (perf && perf->available() && keys > 0) {
+			// per key and pass over the keys
+			Json::Value &cs = root["counters"] = Json::Value(Json::objectValue);
+			for (unsigned i=0; i<PHASE_COUNT; i++) {
+				if (phaseCalls[i] == 0) {
+					continue;
+				}
+				Json::Value &c = cs[PHASE_NAMES[i]] = Json::Value(Json::objectValue);
+				double div = (double)phaseCalls[i] * (double)keys;
+				for (unsigned e=0; e<PerfCounters::EVENT_COUNT; e++) {
+					auto ev = (PerfCounters::Event)e;
+					if (perf->available(ev)) {
+						c[std::string(PerfCounters::name(ev)) + "_per_key"] =
+								(double)perfPhases[i].v[e] / div;
+					}
+				}
+			}
+		}
+		if (bytes > 0) {
+			root["bytes"] = (Json::UInt64)bytes;
+			root["bits_per_key"] = keys ? 8.0 * (double)bytes / (double)keys : 0.0;
+		}
+		return root;
+	}
+
+	void write(std::ostream &out) const {
+		Json::StreamWriterBuilder builder;
+		builder["indentation"] = "\t";
+		out << Json::writeString(builder, toJSON()) << std::endl;
+	}
+};
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <memory_resource>
+#include <utility>
+#include <stdexcept>
+
+#include "parallel.hpp"
+
+/**
+ * Union find that several threads may update concurrently without locks
+ * (Anderson and Woll, Wait-free Parallel Algorithms for the Union-Find
+ * Problem).
+ *
+ * The parent links are changed with compare-and-swap only. Roots are
+ * linked by index (the root with the smaller index becomes a child of
+ * the other one), which keeps the links acyclic without any counters
+ * that would have to be updated together with them. Finds halve the
+ * path they follow, which again is a compare-and-swap that may fail
+ * harmlessly.
+ */
+class ConcurrentUnionFind {
+public:
+	using size_t = std::size_t;
+	using uint32_t = std::uint32_t;
+
+private:
+	const size_t n;
+	std::pmr::vector<uint32_t> parents;
+
+	void checkIndex(size_t x) const {
+		if (x >= n) {
+			throw std::runtime_error("invalid index");
+		}
+	}
+
+	uint32_t parent(uint32_t i) const {
+		return __atomic_load_n(&parents[i], __ATOMIC_ACQUIRE);
+	}
+
+	uint32_t find(uint32_t i) {
+		while (true) {
+			uint32_t p = parent(i);
+			if (p == i) {
+				return i;
+			}
+			uint32_t gp = parent(p);
+			if (gp != p) {
+				// path halving, fails if another thread changed the link
+				__atomic_compare_exchange_n(&parents[i], &p, gp, true,
+						__ATOMIC_RELEASE, __ATOMIC_RELAXED);
+			}
+			i = gp;
+		}
+	}
+
+public:
+	ConcurrentUnionFind(size_t n,
+			std::pmr::memory_resource *mr = std::pmr::get_default_resource()) :
+			n(n), parents(n, mr) {
+		if (n > UINT32_MAX) {
+			throw std::runtime_error("too many nodes");
+		}
+		clear();
+	}
+
+	size_t getN() const {
+		return n;
+	}
+
+	/**
+	 * Make every node a root, must not run concurrently with other calls.
+	 */
+	void clear(unsigned threads = 1) {
+		Parallel::forRange(threads, n, [&](size_t b, size_t e, unsigned t) {
+			(void)t;
+			for (size_t i = b; i<e; i++) {
+				parents[i] = (uint32_t)i;
+			}
+		});
+	}
+
+	size_t findIdentity(size_t i) {
+		checkIndex(i);
+		return find((uint32_t)i);
+	}
+
+	/**
+	 * Merge the sets of i and j, may run concurrently with other calls.
+	 * @return true if i and j already were in the same set
+	 */
+	bool doUnion(size_t i, size_t j) {
+		checkIndex(i);
+		checkIndex(j);
+		uint32_t ri = (uint32_t)i;
+		uint32_t rj = (uint32_t)j;
+		while (true) {
+			ri = find(ri);
+			rj = find(rj);
+			if (ri == rj) {
+				return true;
+			}
+			if (ri > rj) {
+				std::swap(ri, rj);
+			}
+			// link ri below rj, fails if ri is no root anymore
+			uint32_t expected = ri;
+			if (__atomic_compare_exchange_n(&parents[ri], &expected, rj, false,
+					__ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+				return false;
+			}
+		}
+	}
+
+	/**
+	 * Insert edges from several threads, each one from a contiguous
+	 * slice of [0,count), and stop all of them at the first cycle.
+	 * @param edge edge(i, a, b) stores the nodes of edge i in a and b
+	 * @return true if a cycle (or parallel edge or loop) was found
+	 */
+	template <class E>
+	bool findCycle(unsigned threads, size_t count, E &&edge) {
+		bool cycle = false;
+		Parallel::forRange(threads, count, [&](size_t b, size_t e, unsigned t) {
+			(void)t;
+			for (size_t i = b; i<e; i++) {
+				if (__atomic_load_n(&cycle, __ATOMIC_RELAXED)) {
+					return;
+				}
+				size_t x, y;
+				edge(i, x, y);
+				if (doUnion(x, y)) {
+					__atomic_store_n(&cycle, true, __ATOMIC_RELAXED);
+					return;
+				}
+			}
+		});
+		return cycle;
+	}
+};
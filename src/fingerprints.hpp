@@ -0,0 +1,95 @@
+#pragma once
+
+#include <string>
+#include <memory>
+
+#include "randtools.hpp"
+#include "hashtools.hpp"
+#include "bitarray.hpp"
+#include "algo.hpp"
+
+/**
+ * A column of key fingerprints indexed by a minimal perfect hash
+ * function F (e.g., AlgoBDZ2, AlgoBDZ3, or AlgoCHD).
+ *
+ * F maps keys that are not in the map to arbitrary slots. Comparing the
+ * fingerprint stored in the slot with the fingerprint of the key rejects
+ * such keys, except with a probability of about 2^-bits.
+ */
+template <class F>
+class Fingerprints {
+public:
+	using string = std::string;
+	using size_t = std::size_t;
+	using uint64_t = std::uint64_t;
+
+	static constexpr unsigned MIN_BITS = 4;
+	static constexpr unsigned MAX_BITS = 16;
+
+private:
+	F &f;
+	size_t m = 0;
+	unsigned bits = 0;
+	// hash function of the fingerprints
+	std::unique_ptr<HashFuncs<1>> funcs;
+	PackedArray fps;
+
+	uint64_t fingerprint(const string &key) {
+		return funcs->hf[0].hash(key) >> (32 - bits);
+	}
+
+public:
+	/**
+	 * @param f minimal perfect hash function, must outlive the column
+	 */
+	Fingerprints(F &f) : f(f) {
+		// nothing
+	}
+
+	/**
+	 * Store the fingerprints of the keys of map, f must have been built
+	 * for the keys of map.
+	 * @param folding the character folding used by f
+	 * @param bits bits per fingerprint, from MIN_BITS to MAX_BITS
+	 */
+	void build(randgen_t &randgen, const map_t &map, unsigned folding, unsigned bits) {
+		if (bits < MIN_BITS || bits > MAX_BITS) {
+			throw std::runtime_error("fingerprints must have 4 to 16 bits");
+		}
+		m = map.size();
+		this->bits = bits;
+		RandRange rs32Bit(randgen, 0, UINT32_MAX);
+		funcs = std::make_unique<HashFuncs<1>>(folding, rs32Bit);
+		funcs->randomize();
+		fps.assign(m, bits);
+		for (auto &x : map) {
+			fps.set(f.lookup(x.first), fingerprint(x.first));
+		}
+	}
+
+	unsigned getBits() const {
+		return bits;
+	}
+
+	size_t bytes() const {
+		return fps.bytes();
+	}
+
+	/**
+	 * Look up the slot of a key that may not be in the map.
+	 * @param i receives the slot of the key
+	 * @return false if the key is definitely not in the map
+	 */
+	bool find(const string &key, size_t &i) {
+		i = f.lookup(key);
+		return i < m && fps.get(i) == fingerprint(key);
+	}
+
+	/**
+	 * @return false if the key is definitely not in the map
+	 */
+	bool contains(const string &key) {
+		size_t i;
+		return find(key, i);
+	}
+};
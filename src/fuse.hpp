@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+#include "hashtools.hpp"
+
+/**
+ * Layout of a spatially coupled (fuse) 3-hypergraph.
+ *
+ * The nodes are split into segments of 2^k nodes. An edge starts in
+ * one of the first segmentCount segments and has one node in each of
+ * three consecutive segments. Such hypergraphs can be peeled at a load
+ * of up to about 0.89 (instead of 0.81 for three independent parts),
+ * and the nodes of an edge are close to each other.
+ */
+class FuseLayout {
+public:
+	using size_t = std::size_t;
+	using uint32_t = std::uint32_t;
+	using uint64_t = std::uint64_t;
+
+	static constexpr unsigned MAX_SEGMENT_BITS = 18;
+
+private:
+	// bits of each offset in the mixed hash
+	static constexpr unsigned OFFSET_SHIFT = 21;
+
+	unsigned segmentBits = 0;
+	uint32_t segmentCount = 0;
+	FastMod fm;
+
+public:
+	FuseLayout() {
+		// nothing
+	}
+
+	/**
+	 * @param nodes maximum number of nodes
+	 * @param segmentBits log2 of the segment length
+	 */
+	FuseLayout(size_t nodes, unsigned segmentBits) : segmentBits(segmentBits) {
+		if (segmentBits > MAX_SEGMENT_BITS) {
+			throw std::runtime_error("segments too long");
+		}
+		size_t segments = nodes >> segmentBits;
+		if (segments < 3 || nodes > UINT32_MAX) {
+			throw std::runtime_error("invalid number of segments");
+		}
+		segmentCount = (uint32_t)(segments - 2);
+		fm = FastMod(segmentCount);
+	}
+
+	/**
+	 * log2 of a suitable segment length for m edges
+	 * (Graf and Lemire, Binary Fuse Filters).
+	 */
+	static unsigned segmentBitsFor(size_t m) {
+		if (m <= 1) {
+			return 0;
+		}
+		double b = std::floor(std::log((double)m) / std::log(3.33) + 2.25);
+		return (unsigned)std::min(b, (double)MAX_SEGMENT_BITS);
+	}
+
+	/**
+	 * Ratio of nodes to edges that is usually sufficient for m edges.
+	 * Small hypergraphs need more space.
+	 */
+	static double sizeFactor(size_t m) {
+		if (m <= 1) {
+			return 4.0;
+		}
+		return std::max(1.125, 0.875 + 0.25 * std::log(1000000.0) / std::log((double)m));
+	}
+
+	/**
+	 * Number of nodes (at most the number given to the constructor).
+	 */
+	size_t size() const {
+		return (size_t)(segmentCount + 2) << segmentBits;
+	}
+
+	uint32_t getSegmentLength() const {
+		return (uint32_t)1 << segmentBits;
+	}
+
+	/**
+	 * Mix two 32 bit hashes into the 64 bit hash used for the offsets
+	 * (the finalizer of MurmurHash3).
+	 */
+	static uint64_t mix(uint32_t a, uint32_t b) {
+		uint64_t h = ((uint64_t)a << 32) | b;
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+		return h;
+	}
+
+	/**
+	 * The nodes of an edge.
+	 * @param hseg hash that selects the first segment
+	 * @param hoff mixed hash that selects the offsets within the segments
+	 */
+	void nodes(uint32_t hseg, uint64_t hoff, uint32_t &h1, uint32_t &h2, uint32_t &h3) const {
+		uint32_t mask = getSegmentLength() - 1;
+		uint32_t s = fm.mod(hseg);
+		h1 = ((s + 0) << segmentBits) + ((uint32_t)(hoff >> (0 * OFFSET_SHIFT)) & mask);
+		h2 = ((s + 1) << segmentBits) + ((uint32_t)(hoff >> (1 * OFFSET_SHIFT)) & mask);
+		h3 = ((s + 2) << segmentBits) + ((uint32_t)(hoff >> (2 * OFFSET_SHIFT)) & mask);
+	}
+};
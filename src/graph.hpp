@@ -1,20 +1,73 @@
 #pragma once
 
-#include <memory>
-#include <unordered_map>
+#include <cstdint>
+#include <vector>
+#include <memory_resource>
+#include <stdexcept>
 
+/**
+ * An undirected graph with a value for each edge, stored in compressed
+ * sparse row form: the adjacency lists of all nodes are consecutive in
+ * a single array, and node i's list starts at offsets[i].
+ *
+ * Edges are first collected with addEdge() and then arranged with
+ * build() in two passes (count degrees, fill the lists). All buffers
+ * are kept by clear(), so a graph can be rebuilt for every trial
+ * without allocations, and may come from a BuildContext.
+ */
 class Graph {
 public:
 	using size_t = std::size_t;
+	using uint32_t = std::uint32_t;
 	using edge_t = std::uint64_t;
 
-	using adj_t = std::pair<size_t, edge_t>;
-	using adjList_t = std::vector<adj_t>;
-//	using adjList_t = std::unordered_map<size_t, edge_t>;
+	struct adj_t {
+		/**
+		 * The neighbor.
+		 */
+		uint32_t first;
+		/**
+		 * Index of the edge, see value().
+		 */
+		uint32_t edge;
+	};
+
+	/**
+	 * The adjacency list of a node.
+	 */
+	class adjList_t {
+	private:
+		const adj_t *b;
+		const adj_t *e;
+	public:
+		adjList_t(const adj_t *b, const adj_t *e) : b(b), e(e) {
+			// nothing
+		}
+		const adj_t *begin() const {
+			return b;
+		}
+		const adj_t *end() const {
+			return e;
+		}
+		size_t size() const {
+			return (size_t)(e - b);
+		}
+	};
 
 private:
-	const size_t n;
-	std::unique_ptr<adjList_t[]> adjLists;
+	size_t n;
+	bool built = false;
+
+	// edges in order of addEdge
+	std::pmr::vector<uint32_t> ends;
+	std::pmr::vector<edge_t> values;
+
+	// adjacency lists
+	std::pmr::vector<uint32_t> offsets;
+	std::pmr::vector<adj_t> adj;
+
+	// scratch space of hasParallels
+	std::pmr::vector<uint32_t> marks;
 
 	void checkIndex(size_t x) const {
 		if (x >= n) {
@@ -22,9 +75,18 @@ private:
 		}
 	}
 
+	void checkBuilt() const {
+		if (!built) {
+			throw std::runtime_error("graph not built");
+		}
+	}
+
 public:
-	Graph(size_t n) : n(n) {
-		adjLists = std::make_unique<adjList_t[]>(n);
+	Graph(size_t n, std::pmr::memory_resource *mr = std::pmr::get_default_resource()) :
+			n(n), ends(mr), values(mr), offsets(mr), adj(mr), marks(mr) {
+		if (n >= UINT32_MAX) {
+			throw std::runtime_error("too many nodes");
+		}
 	}
 	virtual ~Graph() {
 		// nothing
@@ -34,96 +96,96 @@ public:
 		return n;
 	}
 
-	void clear() {
-		for (size_t i=0; i<n; i++) {
-			adjLists[i].clear();
-		}
-	}
-
-	void addEdge(size_t i, size_t j, const edge_t &v) {
-		checkIndex(i);
-		checkIndex(j);
-		adjLists[i].push_back(adj_t(j, v));
-		adjLists[j].push_back(adj_t(i, v));
-//		adjLists[i][j] = v;
-//		adjLists[j][i] = v;
+	size_t getM() const {
+		return values.size();
 	}
 
-	const adjList_t & adjList(size_t i) const {
-		checkIndex(i);
-		return adjLists[i];
+	/**
+	 * Remove all edges.
+	 */
+	void clear() {
+		ends.clear();
+		values.clear();
+		built = false;
 	}
 
-	size_t degree(size_t i) const {
+	/**
+	 * Add an edge, takes effect with the next build().
+	 * @return index of the edge
+	 */
+	size_t addEdge(size_t i, size_t j, const edge_t &v) {
 		checkIndex(i);
-		return adjLists[i].size();
+		checkIndex(j);
+		ends.push_back((uint32_t)i);
+		ends.push_back((uint32_t)j);
+		values.push_back(v);
+		built = false;
+		return values.size() - 1;
 	}
-};
 
-/**
- * A graph without parallels.
- */
-class GraphSimple {
-public:
-	using size_t = std::size_t;
-	using edge_t = std::uint64_t;
-
-	using adjList_t = std::unordered_map<size_t, edge_t>;
-
-private:
-	const size_t n;
-	std::unique_ptr<adjList_t[]> adjLists;
-
-	void checkIndex(size_t x) const {
-		if (x >= n) {
-			throw std::runtime_error("invalid index");
+	/**
+	 * Arrange the adjacency lists of the edges added since clear().
+	 */
+	void build() {
+		size_t m = values.size();
+		if (2*m >= UINT32_MAX) {
+			throw std::runtime_error("too many edges");
+		}
+		// count degrees, offsets[i+1] is the end of node i's list
+		offsets.assign(n + 1, 0);
+		for (uint32_t x : ends) {
+			offsets[x + 1]++;
 		}
-	}
-
-public:
-	GraphSimple(size_t n) : n(n) {
-		adjLists = std::make_unique<adjList_t[]>(n);
-	}
-	virtual ~GraphSimple() {
-		// nothing
-	}
-
-	size_t getN() const {
-		return n;
-	}
-
-	void clear() {
 		for (size_t i=0; i<n; i++) {
-			adjLists[i].clear();
+			offsets[i + 1] += offsets[i];
 		}
+		// fill, offsets[i] is moved to the end of node i's list
+		adj.resize(2*m);
+		for (size_t e=0; e<m; e++) {
+			uint32_t a = ends[2*e];
+			uint32_t b = ends[2*e + 1];
+			adj[offsets[a]++] = adj_t { b, (uint32_t)e };
+			adj[offsets[b]++] = adj_t { a, (uint32_t)e };
+		}
+		// restore the starts
+		for (size_t i=n; i>0; i--) {
+			offsets[i] = offsets[i - 1];
+		}
+		offsets[0] = 0;
+		built = true;
 	}
 
 	/**
-	 * Add an edge if it does not already exist.
-	 * @param i
-	 * @param j
-	 * @param v
-	 * @return true iff the edge was added
+	 * Whether two edges connect the same pair of nodes, requires build().
 	 */
-	bool addEdge(size_t i, size_t j, const edge_t &v) {
-		checkIndex(i);
-		checkIndex(j);
-		auto r1 = adjLists[i].insert(adjList_t::value_type(j, v));
-		auto r2 = adjLists[j].insert(adjList_t::value_type(i, v));
-		if (r1.second != r2.second) {
-			throw std::runtime_error("internal error");
+	bool hasParallels() {
+		checkBuilt();
+		marks.assign(n, UINT32_MAX);
+		for (size_t i=0; i<n; i++) {
+			for (size_t k=offsets[i]; k<offsets[i + 1]; k++) {
+				uint32_t j = adj[k].first;
+				if (marks[j] == i) {
+					return true;
+				}
+				marks[j] = (uint32_t)i;
+			}
 		}
-		return r1.second;
+		return false;
+	}
+
+	const edge_t &value(size_t e) const {
+		return values[e];
 	}
 
-	const adjList_t & adjList(size_t i) const {
+	adjList_t adjList(size_t i) const {
 		checkIndex(i);
-		return adjLists[i];
+		checkBuilt();
+		return adjList_t(adj.data() + offsets[i], adj.data() + offsets[i + 1]);
 	}
 
 	size_t degree(size_t i) const {
 		checkIndex(i);
-		return adjLists[i].size();
+		checkBuilt();
+		return offsets[i + 1] - offsets[i];
 	}
 };
-
@@ -1,9 +1,92 @@
 #pragma once
 
+#include <array>
 #include <string>
 #include <memory>
+#include <memory_resource>
+#include <utility>
+#include <type_traits>
+#include <stdexcept>
+#include <algorithm>
 
 #include "randtools.hpp"
+#include "simdhash.hpp"
+
+/**
+ * Computes x mod n for 32 bit values with two multiplications
+ * instead of a division (Lemire et al., "Faster Remainder by Direct
+ * Computation"). The result is exact.
+ */
+class FastMod {
+private:
+	uint64_t m = 0;
+	uint32_t n = 0;
+
+public:
+	FastMod() {
+		// nothing
+	}
+
+	FastMod(uint32_t n) : m(UINT64_MAX / n + 1), n(n) {
+		// nothing
+	}
+
+	uint32_t mod(uint32_t x) const {
+		uint64_t low = m * x;
+		return (uint32_t)(((unsigned __int128)low * n) >> 64);
+	}
+};
+
+/**
+ * Flags for character folding, see CharFold.
+ */
+enum : unsigned {
+	FOLD_NONE = 0,
+	/**
+	 * Map ASCII upper case letters to lower case.
+	 */
+	FOLD_CASE = 1,
+	/**
+	 * Map '_' to '-'.
+	 */
+	FOLD_DASH = 2,
+};
+
+/**
+ * Translation table for character folding.
+ * Folding is applied to each character before it is preprocessed,
+ * so keys never need to be normalized into temporary copies.
+ */
+class CharFold {
+private:
+	unsigned char table[256];
+
+public:
+	CharFold(unsigned flags) {
+		for (unsigned i=0; i<256; i++) {
+			unsigned char c = (unsigned char)i;
+			if ((flags & FOLD_CASE) && c >= 'A' && c <= 'Z') {
+				c = (unsigned char)(c - 'A' + 'a');
+			}
+			if ((flags & FOLD_DASH) && c == '_') {
+				c = '-';
+			}
+			table[i] = c;
+		}
+	}
+
+	char apply(char c) const {
+		return (char)table[(unsigned char)c];
+	}
+
+	std::string apply(const std::string &s) const {
+		std::string r(s);
+		for (char &c : r) {
+			c = apply(c);
+		}
+		return r;
+	}
+};
 
 class Preprocessor {
 public:
@@ -11,8 +94,26 @@ public:
 		// nothing
 	}
 
-	virtual uint32_t preprocess(size_t i, char c) = 0;
+	virtual uint32_t preprocess(size_t i, char c) const = 0;
 	virtual void randomize() = 0;
+
+	/**
+	 * Move the tables, if any, to memory from mr.
+	 */
+	virtual void moveTo(std::pmr::memory_resource *mr) {
+		(void)mr;
+	}
+
+	/**
+	 * Preprocess all characters of a key, out[i*stride] receives
+	 * the preprocessed character i.
+	 */
+	virtual void preprocessKey(const std::string &s, uint32_t *out, size_t stride) const {
+		size_t len = s.length();
+		for (size_t i=0; i<len; i++) {
+			out[i*stride] = preprocess(i, s[i]);
+		}
+	}
 };
 
 class HashFunc {
@@ -21,8 +122,17 @@ public:
 		// nothing
 	}
 
-	virtual uint32_t hash(const std::string &s) = 0;
+	virtual uint32_t hash(const std::string &s) const = 0;
 	virtual void randomize() = 0;
+
+	/**
+	 * Hash several keys at once, out[i] receives the hash of keys[i].
+	 */
+	virtual void hashBatch(const std::string *keys, size_t count, uint32_t *out) const {
+		for (size_t i=0; i<count; i++) {
+			out[i] = hash(keys[i]);
+		}
+	}
 };
 
 
@@ -33,7 +143,7 @@ public:
 		// nothing
 	}
 
-	uint32_t preprocess(size_t i, char c) override {
+	uint32_t preprocess(size_t i, char c) const override {
 		(void)i;
 		return (unsigned char)c;
 	}
@@ -43,25 +153,39 @@ public:
 	}
 };
 
-class PreMult : public Preprocessor {
-private:
+/**
+ * Base of the preprocessors with a random value per position, for keys of
+ * up to n characters.
+ *
+ * The table is taken from mr. Algorithms pass their BuildContext during
+ * a run and move the table of the function they keep to the heap with
+ * moveTo(), so failed runs do not allocate.
+ */
+class PreTable : public Preprocessor {
+protected:
 	const size_t n;
 	RandSource &rs;
-	std::unique_ptr<uint32_t[]> table;
+	std::pmr::memory_resource *mr;
+	uint32_t *table;
 
-public:
-	PreMult(size_t n, RandSource &rs) : n(n), rs(rs) {
-		table = std::make_unique<uint32_t[]>(n);
-		for (size_t i=0; i<n; i++) {
-			table[i] = 1;
-		}
+	PreTable(size_t n, RandSource &rs, uint32_t init, std::pmr::memory_resource *mr)
+			: n(n), rs(rs), mr(mr) {
+		table = (uint32_t *)mr->allocate(n * sizeof(uint32_t), alignof(uint32_t));
+		std::fill(table, table + n, init);
 	}
 
-	uint32_t preprocess(size_t i, char c) override {
+	void checkIndex(size_t i) const {
 		if (i >= n) {
 			throw std::runtime_error("internal error");
 		}
-		return table[i] * (unsigned char)c;
+	}
+
+public:
+	PreTable(const PreTable &) = delete;
+	PreTable &operator=(const PreTable &) = delete;
+
+	~PreTable() override {
+		mr->deallocate(table, n * sizeof(uint32_t), alignof(uint32_t));
 	}
 
 	void randomize() override {
@@ -69,32 +193,68 @@ public:
 			table[i] = rs.get();
 		}
 	}
+
+	void moveTo(std::pmr::memory_resource *to) override {
+		uint32_t *t = (uint32_t *)to->allocate(n * sizeof(uint32_t), alignof(uint32_t));
+		std::copy(table, table + n, t);
+		mr->deallocate(table, n * sizeof(uint32_t), alignof(uint32_t));
+		table = t;
+		mr = to;
+	}
 };
 
-class PreXOR : public Preprocessor {
-private:
-	const size_t n;
-	RandSource &rs;
-	std::unique_ptr<uint32_t[]> table;
+class PreMult : public PreTable {
+public:
+	PreMult(size_t n, RandSource &rs,
+			std::pmr::memory_resource *mr = std::pmr::new_delete_resource())
+			: PreTable(n, rs, 1, mr) {
+		// nothing
+	}
 
+	uint32_t preprocess(size_t i, char c) const override {
+		checkIndex(i);
+		return table[i] * (unsigned char)c;
+	}
+};
+
+class PreXOR : public PreTable {
 public:
-	PreXOR(size_t n, RandSource &rs) : n(n), rs(rs) {
-		table = std::make_unique<uint32_t[]>(n);
-		for (size_t i=0; i<n; i++) {
-			table[i] = 0;
-		}
+	PreXOR(size_t n, RandSource &rs,
+			std::pmr::memory_resource *mr = std::pmr::new_delete_resource())
+			: PreTable(n, rs, 0, mr) {
+		// nothing
 	}
 
-	uint32_t preprocess(size_t i, char c) override {
-		if (i >= n) {
-			throw std::runtime_error("internal error");
-		}
+	uint32_t preprocess(size_t i, char c) const override {
+		checkIndex(i);
 		return table[i] ^ (unsigned char)c;
 	}
+};
 
-	void randomize() override {
-		for (size_t i=0; i<n; i++) {
-			table[i] = rs.get();
+
+/**
+ * Folds each character before passing it to the preprocessor P.
+ */
+template <class P>
+class PreFold : public P {
+private:
+	const CharFold fold;
+
+public:
+	template <typename... Args>
+	PreFold(unsigned flags, Args&&... args)
+		: P(std::forward<Args>(args)...), fold(flags) {
+		// nothing
+	}
+
+	uint32_t preprocess(size_t i, char c) const override {
+		return P::preprocess(i, fold.apply(c));
+	}
+
+	void preprocessKey(const std::string &s, uint32_t *out, size_t stride) const override {
+		size_t len = s.length();
+		for (size_t i=0; i<len; i++) {
+			out[i*stride] = P::preprocess(i, fold.apply(s[i]));
 		}
 	}
 };
@@ -114,7 +274,7 @@ public:
 		// nothing
 	}
 
-	uint32_t hash(const std::string &s) {
+	uint32_t hash(const std::string &s) const override {
 		uint32_t r = seed;
 		size_t len = s.length();
 		for (size_t i=0; i<len; i++) {
@@ -133,16 +293,83 @@ public:
 class HashJenkinsOneAtATime : public HashFunc {
 private:
 	// https://en.wikipedia.org/wiki/Jenkins_hash_function
+	using lanes = JenkinsLanes;
+
 	Preprocessor &p;
 	RandSource &rseed;
 	uint32_t seed = 0;
 
+	// keys sorted at once by hashBatch, and the longest key that is
+	// hashed in the SIMD lanes (longer keys are hashed one by one)
+	static constexpr size_t BLOCK = 256;
+	static constexpr size_t MAX_LANE_LEN = 64;
+
+	/**
+	 * Counting sort of at most BLOCK keys by length.
+	 */
+	static void sortByLength(const std::string *keys, size_t count, uint16_t *order) {
+		size_t buckets[MAX_LANE_LEN + 1] = {};
+		for (size_t i=0; i<count; i++) {
+			buckets[std::min(keys[i].length(), MAX_LANE_LEN - 1) + 1]++;
+		}
+		for (size_t b=1; b<=MAX_LANE_LEN; b++) {
+			buckets[b] += buckets[b-1];
+		}
+		for (size_t i=0; i<count; i++) {
+			order[buckets[std::min(keys[i].length(), MAX_LANE_LEN - 1)]++] = (uint16_t)i;
+		}
+	}
+
+	/**
+	 * hashBatchWithSeeds for at most BLOCK keys. The scratch space is
+	 * on the stack, so concurrent calls do not interfere.
+	 */
+	void hashBlock(const std::string *keys, size_t count,
+			const uint32_t *seeds, uint32_t *out) const {
+		uint16_t order[BLOCK];
+		uint32_t chars[MAX_LANE_LEN * lanes::LANES];
+		sortByLength(keys, count, order);
+
+		for (size_t b=0; b<count; b+=lanes::LANES) {
+			size_t k = std::min(lanes::LANES, count - b);
+			uint32_t h[lanes::LANES];
+			uint32_t len[lanes::LANES];
+			size_t maxlen = 0;
+			for (size_t l=0; l<lanes::LANES; l++) {
+				h[l] = (seeds != nullptr && l < k) ? seeds[order[b+l]] : seed;
+				len[l] = (l < k) ? (uint32_t)keys[order[b+l]].length() : 0;
+				maxlen = std::max(maxlen, (size_t)len[l]);
+			}
+			if (maxlen > MAX_LANE_LEN) {
+				for (size_t l=0; l<k; l++) {
+					out[order[b+l]] = hashWithSeed(keys[order[b+l]], h[l]);
+				}
+				continue;
+			}
+			// contents of inactive lanes do not matter
+			for (size_t l=0; l<k; l++) {
+				p.preprocessKey(keys[order[b+l]], chars + l, lanes::LANES);
+			}
+			lanes::run(h, chars, len, maxlen);
+			for (size_t l=0; l<k; l++) {
+				out[order[b+l]] = h[l];
+			}
+		}
+	}
+
 public:
 	HashJenkinsOneAtATime(Preprocessor &p, RandSource &rseed) : p(p), rseed(rseed) {
 		// nothing
 	}
 
-	uint32_t hash(const std::string &s) {
+	uint32_t hash(const std::string &s) const override {
+		return hashWithSeed(s, seed);
+	}
+
+	/**
+	 * Hash with the given seed instead of the current one.
+	 */
+	uint32_t hashWithSeed(const std::string &s, uint32_t seed) const {
 		size_t len = s.length();
 		uint32_t hash = seed;
 		for (size_t i=0; i<len; i++) {
@@ -158,7 +385,92 @@ public:
 		return hash;
 	}
 
+	void hashBatch(const std::string *keys, size_t count, uint32_t *out) const override {
+		hashBatchWithSeeds(keys, count, nullptr, out);
+	}
+
+	/**
+	 * Hashes groups of keys with similar length in the SIMD lanes.
+	 * @param seeds seed for each key, or nullptr for the current seed,
+	 *        may be the same array as out
+	 */
+	void hashBatchWithSeeds(const std::string *keys, size_t count,
+			const uint32_t *seeds, uint32_t *out) const {
+		for (size_t b=0; b<count; b+=BLOCK) {
+			size_t k = std::min(BLOCK, count - b);
+			hashBlock(keys + b, k, (seeds != nullptr) ? seeds + b : nullptr, out + b);
+		}
+	}
+
+	uint32_t getSeed() const {
+		return seed;
+	}
+
 	void randomize() override {
 		seed = rseed.get();
 	}
 };
+
+
+/**
+ * R hash functions of type H, each on its own preprocessor PreFold<P>, as
+ * the algorithms keep them for the function of their last run.
+ *
+ * The functions refer to the random sources they were made with, which
+ * usually live in run(): randomize() may only be called while they exist,
+ * the hashes can be computed afterwards.
+ */
+template <unsigned R, class H = HashJenkinsOneAtATime, class P = PreNone>
+class HashFuncs {
+private:
+	template <class M, unsigned... K, class... Args>
+	HashFuncs(std::integer_sequence<unsigned, K...>, unsigned folding, M &makeHash,
+			Args&... args)
+		: pre{ { ((void)K, PreFold<P>(folding, args...))... } },
+		  hf{ { makeHash(pre[K], K)... } } {
+		// nothing
+	}
+
+public:
+	std::array<PreFold<P>, R> pre;
+	std::array<H, R> hf;
+
+	/**
+	 * @param makeHash makeHash(pre, k) returns hash function k on pre
+	 * @param args arguments of each preprocessor P
+	 */
+	template <class M, class... Args,
+			class = std::enable_if_t<std::is_invocable_v<M &, Preprocessor &, unsigned>>>
+	HashFuncs(unsigned folding, M makeHash, Args&... args)
+		: HashFuncs(std::make_integer_sequence<unsigned, R>(), folding, makeHash, args...) {
+		// nothing
+	}
+
+	/**
+	 * Hash functions H(pre, rseed), for example HashJenkinsOneAtATime.
+	 */
+	HashFuncs(unsigned folding, RandSource &rseed)
+		: HashFuncs(folding, [&rseed](Preprocessor &p, unsigned k) {
+			(void)k;
+			return H(p, rseed);
+		}) {
+		// nothing
+	}
+
+	void randomize() {
+		for (auto &p : pre) {
+			p.randomize();
+		}
+		for (auto &h : hf) {
+			h.randomize();
+		}
+	}
+	/**
+	 * Move the tables of the preprocessors to memory from mr, see PreTable.
+	 */
+	void moveTo(std::pmr::memory_resource *mr) {
+		for (auto &p : pre) {
+			p.moveTo(mr);
+		}
+	}
+};
@@ -0,0 +1,279 @@
+#pragma once
+
+#include <array>
+#include <algorithm>
+#include <vector>
+#include <memory_resource>
+#include <utility>
+#include <cstdint>
+#include <stdexcept>
+
+#include "parallel.hpp"
+
+/**
+ * A hypergraph whose edges have R nodes, R is a compile-time constant.
+ *
+ * Instead of adjacency lists, each node only stores its degree and the
+ * XOR of the indexes of its incident edges. The only edge incident to
+ * a node of degree 1 is then given by the XOR, which is all that
+ * peeling needs.
+ *
+ * peelRounds() peels in synchronous rounds with several threads. All
+ * edges that are incident to a node of degree 1 at the start of a round
+ * are removed in that round, each with the smallest such node. The
+ * result does not depend on the number of threads, and peel() removes
+ * the same edges in the same order with one thread.
+ *
+ * The arrays and the scratch space of peeling may come from a
+ * BuildContext. The scratch space is kept, so peeling the same
+ * hypergraph again in the next trial allocates nothing.
+ */
+template <unsigned R>
+class Hypergraph {
+	static_assert(R >= 2 && R <= 4, "invalid arity");
+
+public:
+	using size_t = std::size_t;
+	using uint32_t = std::uint32_t;
+	using edge_t = std::array<uint32_t, R>;
+
+	/**
+	 * Call fn(k) for k in [0,R), unrolled at compile time.
+	 */
+	template <class Fn>
+	static void each(Fn &&fn) {
+		eachImpl(fn, std::make_integer_sequence<unsigned, R>());
+	}
+
+private:
+	template <class Fn, unsigned... K>
+	static void eachImpl(Fn &fn, std::integer_sequence<unsigned, K...>) {
+		(fn(K), ...);
+	}
+
+	using buffer_t = std::pmr::vector<uint32_t>;
+
+	const size_t n;
+	buffer_t degrees;
+	buffer_t xors;
+	std::pmr::vector<edge_t> edges;
+
+	// scratch space of peeling, kept between trials
+	buffer_t ones;
+	buffer_t claims;
+	buffer_t frontier;
+	buffer_t removed;
+	std::pmr::vector<buffer_t> parts;
+
+	void checkIndex(size_t x) const {
+		if (x >= getN()) {
+			throw std::runtime_error("invalid index");
+		}
+	}
+
+	static void atomicMin(uint32_t &x, uint32_t v) {
+		uint32_t cur = __atomic_load_n(&x, __ATOMIC_RELAXED);
+		while (v < cur && !__atomic_compare_exchange_n(&x, &cur, v, true,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+			// cur was updated
+		}
+	}
+
+	/**
+	 * Concatenate the per thread results in order of the threads.
+	 */
+	void concat(buffer_t &out) {
+		out.clear();
+		for (auto &p : parts) {
+			out.insert(out.end(), p.begin(), p.end());
+			p.clear();
+		}
+	}
+
+public:
+	/**
+	 * @param n number of nodes
+	 * @param m number of edges
+	 * @param mr memory of the arrays and of peeling
+	 */
+	Hypergraph(size_t n, size_t m,
+			std::pmr::memory_resource *mr = std::pmr::get_default_resource()) :
+			n(n), degrees(n, 0, mr), xors(n, 0, mr), edges(mr),
+			ones(mr), claims(mr), frontier(mr), removed(mr), parts(mr) {
+		if (n > UINT32_MAX || m > UINT32_MAX) {
+			throw std::runtime_error("hypergraph too large");
+		}
+		edges.reserve(m);
+	}
+
+	size_t getN() const {
+		return n;
+	}
+
+	size_t getM() const {
+		return edges.size();
+	}
+
+	void clear() {
+		std::fill(degrees.begin(), degrees.end(), 0);
+		std::fill(xors.begin(), xors.end(), 0);
+		edges.clear();
+	}
+
+	void addEdge(const edge_t &e) {
+		uint32_t eidx = (uint32_t)edges.size();
+		each([&](unsigned k) {
+			checkIndex(e[k]);
+			degrees[e[k]]++;
+			xors[e[k]] ^= eidx;
+		});
+		edges.push_back(e);
+	}
+
+	const edge_t &getEdge(size_t idx) const {
+		return edges.at(idx);
+	}
+
+	size_t degree(size_t i) const {
+		checkIndex(i);
+		return degrees[i];
+	}
+
+	/**
+	 * Remove edges incident to nodes of degree 1 until no such edges remain,
+	 * in the order of peelRounds() but with one thread.
+	 *
+	 * The nodes of degree 1 at the start of a round are visited in
+	 * increasing order and their edges removed right away. This removes
+	 * the same edges as the round: a node of degree 1 has only one edge, so
+	 * removing another edge does not change it, and if a smaller node
+	 * removed the same edge, its degree is 0 and it is skipped. Nodes that
+	 * reach degree 1 wait for the next round.
+	 *
+	 * The degrees are consumed, so the hypergraph must be cleared and
+	 * built again before it is peeled again.
+	 * @param seq receives the removed edges in order of removal
+	 * @param nodes receives the node of degree 1 each edge was removed with
+	 * @return number of edges removed
+	 */
+	template <class V>
+	size_t peel(V &seq, V &nodes) {
+		const size_t m0 = seq.size();
+		ones.clear();
+		for (size_t i = 0; i<n; i++) {
+			if (degrees[i] == 1) {
+				ones.push_back((uint32_t)i);
+			}
+		}
+		while (!ones.empty()) {
+			frontier.clear();
+			for (uint32_t node : ones) {
+				if (degrees[node] != 1) {
+					// the edge was removed with a smaller node of this round
+					continue;
+				}
+				uint32_t eidx = xors[node];
+				seq.push_back(eidx);
+				nodes.push_back(node);
+				const edge_t &e = edges[eidx];
+				each([&](unsigned k) {
+					degrees[e[k]]--;
+					xors[e[k]] ^= eidx;
+					// degrees only decrease, so each node is added once
+					if (degrees[e[k]] == 1) {
+						frontier.push_back(e[k]);
+					}
+				});
+			}
+			std::sort(frontier.begin(), frontier.end());
+			ones.swap(frontier);
+		}
+
+		return seq.size() - m0;
+	}
+
+	/**
+	 * Peel in synchronous rounds, see the class comment.
+	 * The degrees are consumed as by peel().
+	 * @param seq receives the removed edges, round by round, within a
+	 *        round ordered by the node they were removed with
+	 * @param nodes receives the node of degree 1 each edge was removed with
+	 * @param rounds receives the index in seq at which each round ends
+	 * @param threads number of threads
+	 * @return number of edges removed
+	 */
+	template <class V>
+	size_t peelRounds(V &seq, V &nodes, V &rounds, unsigned threads) {
+		const size_t m0 = seq.size();
+		claims.assign(edges.size(), UINT32_MAX);
+		parts.resize(std::max(threads, 1u));
+
+		// nodes of degree 1, in increasing order
+		Parallel::forRange(threads, n, [&](size_t b, size_t e, unsigned t) {
+			for (size_t i = b; i<e; i++) {
+				if (degrees[i] == 1) {
+					parts[t].push_back((uint32_t)i);
+				}
+			}
+		});
+		concat(frontier);
+
+		while (!frontier.empty()) {
+			// each edge is claimed by its smallest node of degree 1
+			Parallel::forRange(threads, frontier.size(), [&](size_t b, size_t e, unsigned t) {
+				(void)t;
+				for (size_t i = b; i<e; i++) {
+					uint32_t node = frontier[i];
+					if (degrees[node] == 1) {
+						atomicMin(claims[xors[node]], node);
+					}
+				}
+			});
+			Parallel::forRange(threads, frontier.size(), [&](size_t b, size_t e, unsigned t) {
+				for (size_t i = b; i<e; i++) {
+					uint32_t node = frontier[i];
+					if (degrees[node] == 1 && claims[xors[node]] == node) {
+						parts[t].push_back(node);
+					}
+				}
+			});
+			concat(removed);
+			for (uint32_t node : removed) {
+				seq.push_back(xors[node]);
+				nodes.push_back(node);
+			}
+			size_t start = seq.size() - removed.size();
+			rounds.push_back(seq.size());
+
+			// remove the edges of this round
+			Parallel::forRange(threads, removed.size(), [&](size_t b, size_t e, unsigned t) {
+				(void)t;
+				for (size_t i = b; i<e; i++) {
+					uint32_t eidx = (uint32_t)seq[start + i];
+					const edge_t &edge = edges[eidx];
+					each([&](unsigned k) {
+						__atomic_fetch_sub(&degrees[edge[k]], 1, __ATOMIC_RELAXED);
+						__atomic_fetch_xor(&xors[edge[k]], eidx, __ATOMIC_RELAXED);
+					});
+				}
+			});
+
+			// nodes of degree 1 for the next round
+			Parallel::forRange(threads, removed.size(), [&](size_t b, size_t e, unsigned t) {
+				for (size_t i = b; i<e; i++) {
+					const edge_t &edge = edges[seq[start + i]];
+					each([&](unsigned k) {
+						if (degrees[edge[k]] == 1) {
+							parts[t].push_back(edge[k]);
+						}
+					});
+				}
+			});
+			concat(frontier);
+			std::sort(frontier.begin(), frontier.end());
+			frontier.erase(std::unique(frontier.begin(), frontier.end()), frontier.end());
+		}
+
+		return seq.size() - m0;
+	}
+};
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+
+#include "randtools.hpp"
+#include "primetest.hpp"
+#include "algo.hpp"
+
+/**
+ * Search for a small n for which an algorithm succeeds, instead of
+ * stepping n up from factor_init() with all trials at every step.
+ *
+ * The search starts at the larger of factor_init() and the load
+ * threshold factor_min(m), and gallops upward with growing steps until a
+ * run succeeds. Each candidate gets only as many trials as a share of the
+ * remaining time budget allows: if they all fail, the success rate at
+ * that n is too small for the budget and n counts as too small. Then the
+ * range between the largest failed n (or the smaller of the two factors,
+ * if the first run succeeded) and the smallest successful n is bisected.
+ * If the last run failed, the function is built again at the smallest
+ * successful n, with up to maxTrials trials.
+ *
+ * All n are prime, as with the fixed stepping.
+ *
+ * Each candidate is a single run, so the BuildStats of the algorithm
+ * record one run per candidate. With a seed in the TrialSeeds of the
+ * algorithm, the search is reproducible.
+ */
+class LoadSearch {
+public:
+	using size_t = std::size_t;
+	using uint32_t = std::uint32_t;
+	using clock = std::chrono::steady_clock;
+
+private:
+	double budget = 1.0;
+	size_t minTrials = 4;
+	size_t maxTrials = 1000;
+	unsigned bisections = 6;
+
+	// state of the current search
+	clock::time_point start;
+	double trialTime = 0;
+	size_t runs = 0;
+	uint32_t lastN = 0;
+
+	double elapsed() const {
+		return std::chrono::duration<double>(clock::now() - start).count();
+	}
+
+	/**
+	 * Trials for the next candidate: a quarter of the remaining budget.
+	 */
+	size_t trialsFor() const {
+		if (trialTime <= 0) {
+			return minTrials;
+		}
+		double rest = std::max(budget - elapsed(), 0.0);
+		double t = rest / 4 / trialTime;
+		return std::clamp((size_t)t, minTrials, maxTrials);
+	}
+
+	/**
+	 * The smallest prime n >= max(m * f, min).
+	 */
+	static uint32_t candidate(randgen_t &randgen, size_t m, double f, uint32_t min = 2) {
+		double n = std::max((double)m * f + 0.5, (double)min);
+		if (n > UINT32_MAX) {
+			throw std::runtime_error("too many elements");
+		}
+		uint32_t ni = (uint32_t)n;
+		while (!PrimeTest::isPrime(ni, PRIMETEST_DEFAULT_ROUNDS, randgen)) {
+			if (ni == UINT32_MAX) {
+				throw std::runtime_error("too many elements");
+			}
+			ni++;
+		}
+		return ni;
+	}
+
+	template <class A>
+	bool tryN(A &algo, randgen_t &randgen, const map_t &map, size_t maxlen,
+			uint32_t n, size_t trials) {
+		clock::time_point t0 = clock::now();
+		bool ok = algo.run(randgen, map, maxlen, n, trials);
+		runs++;
+		lastN = n;
+		if (!ok) {
+			// all trials ran, so this measures the time of one
+			double t = std::chrono::duration<double>(clock::now() - t0).count() / (double)trials;
+			trialTime = (trialTime <= 0) ? t : std::max(trialTime, t);
+		}
+		return ok;
+	}
+
+public:
+	/**
+	 * Set the time in seconds that the search should take, the final
+	 * build may exceed it.
+	 */
+	void setBudget(double seconds) {
+		budget = seconds;
+	}
+
+	/**
+	 * Set the number of trials per candidate n, below the budget at
+	 * least min and at most max, and the number of trials of the final
+	 * build.
+	 */
+	void setTrials(size_t min, size_t max) {
+		if (min == 0 || min > max) {
+			throw std::runtime_error("invalid number of trials");
+		}
+		minTrials = min;
+		maxTrials = max;
+	}
+
+	/**
+	 * Set the number of times the range between a failed and a
+	 * successful n is halved.
+	 */
+	void setBisections(unsigned b) {
+		bisections = b;
+	}
+
+	/**
+	 * Number of runs of the algorithm in the last search.
+	 */
+	size_t getRuns() const {
+		return runs;
+	}
+
+	/**
+	 * Duration of the last search in seconds.
+	 */
+	double getTime() const {
+		return elapsed();
+	}
+
+	/**
+	 * Find n and leave the algorithm with a successful run for it.
+	 * @return n
+	 */
+	template <class A>
+	uint32_t search(A &algo, randgen_t &randgen, const map_t &map, size_t maxlen) {
+		size_t m = map.size();
+		start = clock::now();
+		trialTime = 0;
+		runs = 0;
+
+		// start at the larger factor, the smaller one is presumed to fail:
+		// factor_init below the threshold is the smallest load worth trying
+		// (small key sets may succeed there), a threshold below factor_init
+		// is the least that bisection can reach
+		double lo = std::min(algo.factor_init(), algo.factor_min(m));
+		double hi = std::max(algo.factor_init(), algo.factor_min(m));
+		uint32_t loN = (lo < hi) ? candidate(randgen, m, lo) : 0;
+		uint32_t hiN = candidate(randgen, m, hi, loN + 1);
+
+		// gallop until a run succeeds
+		double step = algo.factor_inc();
+		while (!tryN(algo, randgen, map, maxlen, hiN, trialsFor())) {
+			lo = hi;
+			loN = hiN;
+			hi *= step;
+			step *= step;
+			hiN = candidate(randgen, m, hi, loN + 1);
+		}
+
+		// bisect between the largest failed and the smallest successful n
+		for (unsigned i=0; i<bisections && loN > 0; i++) {
+			double mid = (lo + hi) / 2;
+			uint32_t midN = candidate(randgen, m, mid);
+			if (midN <= loN || midN >= hiN) {
+				break;
+			}
+			if (tryN(algo, randgen, map, maxlen, midN, trialsFor())) {
+				hi = mid;
+				hiN = midN;
+			} else {
+				lo = mid;
+				loN = midN;
+			}
+		}
+
+		// the algorithm only keeps its last run, rebuild if that failed
+		while (lastN != hiN && !tryN(algo, randgen, map, maxlen, hiN, maxTrials)) {
+			hi *= algo.factor_inc();
+			hiN = candidate(randgen, m, hi, hiN + 1);
+		}
+		return hiN;
+	}
+};
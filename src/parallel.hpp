@@ -0,0 +1,210 @@
+#pragma once
+
+#include <cstddef>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+#include "trace.hpp"
+
+/**
+ * Split [0,count) into contiguous ranges, one per thread, and call
+ * fn(begin, end, tid) for each range. Range tid precedes range tid+1,
+ * so results that are collected per thread and concatenated in order
+ * of tid do not depend on the number of threads.
+ *
+ * Small ranges are not worth a thread and run in the calling thread.
+ * With threads, each range is a scope of the active Trace, which shows
+ * how well the work is balanced.
+ *
+ * The ranges run on a pool of threads that is started on first use and
+ * kept, so that a call (a round of peeling, say) costs a wake-up instead
+ * of starting and joining threads. A call while the pool is busy, from
+ * another thread or from within a range, starts threads of its own.
+ * An exception thrown by fn is rethrown in the calling thread once all
+ * ranges have ended. The threads of the pool do not survive fork(), so
+ * a child process must not use threads if its parent did.
+ */
+class Parallel {
+public:
+	using size_t = std::size_t;
+
+	/**
+	 * Minimum number of items per thread.
+	 */
+	static constexpr size_t MIN_CHUNK = 4096;
+
+private:
+	/**
+	 * Worker threads that wait for the ranges of one call at a time.
+	 */
+	class Pool {
+	private:
+		std::atomic<bool> inUse { false };
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::condition_variable done;
+		std::vector<std::thread> workers;
+		bool stop = false;
+
+		// the current call, range 0 runs in the calling thread
+		void (*call)(void *, unsigned) = nullptr;
+		void *arg = nullptr;
+		unsigned parts = 0;
+		unsigned next = 0;
+		unsigned pending = 0;
+		std::exception_ptr error;
+
+		void work() {
+			std::unique_lock<std::mutex> lock(mutex);
+			while (true) {
+				wake.wait(lock, [this] { return stop || next < parts; });
+				if (stop) {
+					return;
+				}
+				unsigned i = next++;
+				lock.unlock();
+				std::exception_ptr e;
+				try {
+					call(arg, i);
+				} catch (...) {
+					e = std::current_exception();
+				}
+				lock.lock();
+				if (e && !error) {
+					error = e;
+				}
+				if (--pending == 0) {
+					done.notify_one();
+				}
+			}
+		}
+
+	public:
+		Pool() {
+			// nothing
+		}
+
+		~Pool() {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stop = true;
+			}
+			wake.notify_all();
+			for (auto &w : workers) {
+				w.join();
+			}
+		}
+
+		/**
+		 * Call call(arg, i) for i in [0,t).
+		 * @return false if the pool is busy, then nothing was called
+		 */
+		bool run(unsigned t, void (*call)(void *, unsigned), void *arg) {
+			if (inUse.exchange(true, std::memory_order_acquire)) {
+				return false;
+			}
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				while (workers.size() < t - 1) {
+					workers.emplace_back([this]() {
+						work();
+					});
+				}
+				this->call = call;
+				this->arg = arg;
+				parts = t;
+				next = 1;
+				pending = t - 1;
+				error = nullptr;
+			}
+			wake.notify_all();
+
+			std::exception_ptr e;
+			try {
+				call(arg, 0);
+			} catch (...) {
+				e = std::current_exception();
+			}
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				done.wait(lock, [this] { return pending == 0; });
+				parts = 0;
+				next = 0;
+				if (!e) {
+					e = error;
+				}
+				error = nullptr;
+			}
+			inUse.store(false, std::memory_order_release);
+			if (e) {
+				std::rethrow_exception(e);
+			}
+			return true;
+		}
+	};
+
+	static Pool &pool() {
+		static Pool p;
+		return p;
+	}
+
+	/**
+	 * Call range(i) for i in [0,t) with threads started for this call.
+	 */
+	template <class Range>
+	static void spawn(unsigned t, Range &range) {
+		std::vector<std::thread> workers;
+		workers.reserve(t - 1);
+		for (unsigned i=1; i<t; i++) {
+			workers.emplace_back([&range, i]() {
+				range(i);
+			});
+		}
+		range(0);
+		for (auto &w : workers) {
+			w.join();
+		}
+	}
+
+public:
+	/**
+	 * Number of threads used for count items.
+	 */
+	static unsigned threadsFor(unsigned threads, size_t count) {
+		size_t t = std::min((size_t)std::max(threads, 1u), count / MIN_CHUNK);
+		return (unsigned)std::max(t, (size_t)1);
+	}
+
+	template <class Fn>
+	static void forRange(unsigned threads, size_t count, Fn &&fn) {
+		unsigned t = threadsFor(threads, count);
+		if (t == 1) {
+			fn((size_t)0, count, 0u);
+			return;
+		}
+		auto range = [&fn, t, count](unsigned i) {
+			size_t b = count * i / t;
+			size_t e = count * (i+1) / t;
+			Trace::Scope scope("range", "items", e - b);
+			fn(b, e, i);
+		};
+		using range_t = decltype(range);
+		if (!pool().run(t, [](void *r, unsigned i) {
+			(*(range_t *)r)(i);
+		}, &range)) {
+			spawn(t, range);
+		}
+	}
+
+	/**
+	 * Number of hardware threads, at least 1.
+	 */
+	static unsigned hardwareThreads() {
+		return std::max(std::thread::hardware_concurrency(), 1u);
+	}
+};
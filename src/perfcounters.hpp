@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Hardware performance counters of the calling thread and the threads
+ * it starts, read with perf_event_open (Linux only).
+ *
+ * The counters run from construction on; read() takes a snapshot and
+ * the difference of two snapshots is what happened in between. Counters
+ * that cannot be opened (other systems, virtual machines without a PMU,
+ * perf_event_paranoid) read as 0 and are reported as unavailable, so
+ * callers need no special case.
+ */
+class PerfCounters {
+public:
+	using size_t = std::size_t;
+	using uint32_t = std::uint32_t;
+	using uint64_t = std::uint64_t;
+
+	enum Event {
+		CYCLES,
+		INSTRUCTIONS,
+		LLC_MISSES,
+		BRANCH_MISSES,
+		DTLB_MISSES,
+		EVENT_COUNT
+	};
+
+	struct Sample {
+		uint64_t v[EVENT_COUNT] = {};
+
+		Sample operator-(const Sample &o) const {
+			Sample d;
+			for (unsigned i=0; i<EVENT_COUNT; i++) {
+				d.v[i] = v[i] - o.v[i];
+			}
+			return d;
+		}
+
+		Sample &operator+=(const Sample &o) {
+			for (unsigned i=0; i<EVENT_COUNT; i++) {
+				v[i] += o.v[i];
+			}
+			return *this;
+		}
+	};
+
+private:
+	int fds[EVENT_COUNT];
+
+#ifdef __linux__
+	static int open(uint32_t type, uint64_t config) {
+		perf_event_attr pe;
+		std::memset(&pe, 0, sizeof(pe));
+		pe.type = type;
+		pe.size = sizeof(pe);
+		pe.config = config;
+		pe.exclude_kernel = 1;
+		pe.exclude_hv = 1;
+		// also count threads started later, such as the workers of Parallel,
+		// a read includes inherited threads while they run and after they exit
+		pe.inherit = 1;
+		return (int)syscall(__NR_perf_event_open, &pe, 0, -1, -1, 0);
+	}
+
+	static uint64_t cache(uint64_t id, uint64_t op, uint64_t result) {
+		return id | (op << 8) | (result << 16);
+	}
+#endif
+
+public:
+	PerfCounters() {
+		for (unsigned i=0; i<EVENT_COUNT; i++) {
+			fds[i] = -1;
+		}
+#ifdef __linux__
+		fds[CYCLES] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+		fds[INSTRUCTIONS] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+		fds[LLC_MISSES] = open(PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_LL,
+				PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS));
+		fds[BRANCH_MISSES] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+		fds[DTLB_MISSES] = open(PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_DTLB,
+				PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS));
+#endif
+	}
+
+	PerfCounters(const PerfCounters &) = delete;
+	PerfCounters &operator=(const PerfCounters &) = delete;
+
+	~PerfCounters() {
+#ifdef __linux__
+		for (unsigned i=0; i<EVENT_COUNT; i++) {
+			if (fds[i] >= 0) {
+				close(fds[i]);
+			}
+		}
+#endif
+	}
+
+	static const char *name(Event e) {
+		static const char *names[EVENT_COUNT] = {
+			"cycles", "instructions", "llc_misses", "branch_misses", "dtlb_misses"
+		};
+		return names[e];
+	}
+
+	bool available(Event e) const {
+		return fds[e] >= 0;
+	}
+
+	/**
+	 * Whether any counter is available.
+	 */
+	bool available() const {
+		for (unsigned i=0; i<EVENT_COUNT; i++) {
+			if (fds[i] >= 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	Sample read() const {
+		Sample s;
+#ifdef __linux__
+		for (unsigned i=0; i<EVENT_COUNT; i++) {
+			if (fds[i] >= 0 && ::read(fds[i], &s.v[i], sizeof(uint64_t)) != sizeof(uint64_t)) {
+				s.v[i] = 0;
+			}
+		}
+#endif
+		return s;
+	}
+
+	/**
+	 * Print the available counters of s divided by keys.
+	 */
+	void write(std::ostream &out, const Sample &s, double keys) const {
+		if (!available()) {
+			out << "no performance counters available" << std::endl;
+			return;
+		}
+		for (unsigned i=0; i<EVENT_COUNT; i++) {
+			if (available((Event)i)) {
+				out << name((Event)i) << " per key: " << (double)s.v[i] / keys << std::endl;
+			}
+		}
+	}
+};
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <random>
 #include <vector>
 
@@ -9,6 +11,80 @@
 using randgen_t = std::mt19937_64;
 using randval_t = std::uint32_t;
 
+/**
+ * Mix the bits of x (the finalizer of SplitMix64), to derive seeds
+ * from a seed and a counter that are as good as independent.
+ */
+inline std::uint64_t mixSeed(std::uint64_t x) {
+	x += 0x9E3779B97F4A7C15ull;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+	return x ^ (x >> 31);
+}
+
+/**
+ * Seeds of reproducible trials. Once a seed is set, an algorithm reseeds
+ * its random generator at the start of trial t of a run with n, from the
+ * seed, n and t. The successful trial of a search can then be repeated
+ * alone: a run with the same seed, n and setFirstTrial(t) and a single
+ * trial builds the same function.
+ */
+class TrialSeeds {
+private:
+	bool enabled = false;
+	std::uint64_t seed = 0;
+	std::size_t first = 0;
+	std::size_t last = 0;
+
+public:
+	TrialSeeds() {
+		// nothing
+	}
+
+	/**
+	 * Seed the trials from s, numbered from 0.
+	 */
+	void setSeed(std::uint64_t s) {
+		enabled = true;
+		seed = s;
+		first = 0;
+	}
+
+	std::uint64_t getSeed() const {
+		return seed;
+	}
+
+	bool isEnabled() const {
+		return enabled;
+	}
+
+	/**
+	 * Number the trials of the following runs from t.
+	 */
+	void setFirstTrial(std::size_t t) {
+		first = t;
+	}
+
+	/**
+	 * Number of the last trial that was started, that of the successful
+	 * one after a successful run.
+	 */
+	std::size_t getLastTrial() const {
+		return last;
+	}
+
+	/**
+	 * Called by the algorithms at the start of trial t of a run with n.
+	 */
+	void reseed(randgen_t &randgen, std::uint32_t n, std::size_t t) {
+		if (!enabled) {
+			return;
+		}
+		last = first + t;
+		randgen.seed(mixSeed(seed ^ mixSeed(((std::uint64_t)n << 32) + last)));
+	}
+};
+
 class RandSource {
 public:
 	virtual ~RandSource() {
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <new>
+#include <memory>
+#include <vector>
+#include <stdexcept>
+
+/**
+ * Rank directory for a bit vector, used to compress the range [0,n')
+ * of a perfect hash function to [0,m): a used value i is mapped to the
+ * number of used values before it.
+ *
+ * The counters are interleaved with the bits in blocks that are aligned
+ * to cache lines, so rank() needs a single cache miss:
+ * - OVERHEAD_3: 128 byte blocks, a 32 bit counter and 992 bits
+ *   (a pair of adjacent cache lines)
+ * - OVERHEAD_6: 64 byte blocks, a 32 bit counter and 480 bits
+ * - OVERHEAD_25: 64 byte blocks, a 32 bit counter, five 9 bit counters
+ *   relative to the start of the block and 384 bits. rank() needs
+ *   a single popcount.
+ */
+class RankDirectory {
+public:
+	using size_t = std::size_t;
+	using uint32_t = std::uint32_t;
+	using uint64_t = std::uint64_t;
+
+	enum Overhead {
+		OVERHEAD_3,
+		OVERHEAD_6,
+		OVERHEAD_25,
+	};
+
+private:
+	static constexpr size_t LINE = 64;
+	static constexpr uint64_t HEADER = 0xFFFFFFFF;
+	static constexpr unsigned REL_BITS = 9;
+
+	struct Free {
+		void operator()(uint64_t *p) const {
+			std::free(p);
+		}
+	};
+
+	Overhead overhead = OVERHEAD_6;
+	size_t n = 0;
+	size_t ones = 0;
+	// 64 bit words per block
+	size_t blockWords = 0;
+	// bits stored per block
+	size_t blockBits = 0;
+	size_t blockCount = 0;
+	// ceil(2^64 / blockBits), so that i / blockBits needs no division
+	uint64_t recip = 0;
+	std::unique_ptr<uint64_t[], Free> words;
+
+	static uint64_t lowMask(size_t b) {
+		return (b > 0) ? (~(uint64_t)0 >> (64 - b)) : 0;
+	}
+
+	/**
+	 * Block of bit i and position of bit i within the block.
+	 */
+	const uint64_t *locate(size_t i, size_t &j) const {
+		size_t blk = (size_t)(((unsigned __int128)i * recip) >> 64);
+		j = i - blk * blockBits;
+		return words.get() + blk * blockWords;
+	}
+
+	/**
+	 * Word and bit position of bit j of a block.
+	 */
+	void position(size_t j, size_t &w, size_t &b) const {
+		size_t p = (overhead == OVERHEAD_25) ? 128 + j : 32 + j;
+		w = p / 64;
+		b = p % 64;
+	}
+
+	void checkIndex(size_t i) const {
+		if (i >= n) {
+			throw std::runtime_error("invalid index");
+		}
+	}
+
+public:
+	RankDirectory() {
+		// nothing
+	}
+
+	/**
+	 * @param bits a vector<bool> with any allocator
+	 */
+	template <class B>
+	void build(const B &bits, Overhead o) {
+		overhead = o;
+		n = bits.size();
+		switch (o) {
+		case OVERHEAD_3:
+			blockWords = 16;
+			blockBits = 1024 - 32;
+			break;
+		case OVERHEAD_6:
+			blockWords = 8;
+			blockBits = 512 - 32;
+			break;
+		case OVERHEAD_25:
+			blockWords = 8;
+			blockBits = 512 - 128;
+			break;
+		default:
+			throw std::runtime_error("invalid overhead");
+		}
+		blockCount = n / blockBits + 1;
+		recip = UINT64_MAX / blockBits + 1;
+
+		size_t bytes = blockCount * blockWords * sizeof(uint64_t);
+		words.reset((uint64_t *)std::aligned_alloc(LINE, bytes));
+		if (!words) {
+			throw std::bad_alloc();
+		}
+		std::fill(words.get(), words.get() + blockCount * blockWords, 0);
+
+		ones = 0;
+		for (size_t blk = 0; blk < blockCount; blk++) {
+			uint64_t *block = words.get() + blk * blockWords;
+			if (ones > UINT32_MAX) {
+				throw std::runtime_error("too many bits set");
+			}
+			block[0] = ones;
+			size_t rel = 0;
+			for (size_t j = 0; j < blockBits; j++) {
+				size_t i = blk * blockBits + j;
+				if (overhead == OVERHEAD_25 && j % 64 == 0 && j > 0) {
+					block[1] |= (uint64_t)rel << (REL_BITS * (j / 64 - 1));
+				}
+				if (i < n && bits[i]) {
+					size_t w, b;
+					position(j, w, b);
+					block[w] |= (uint64_t)1 << b;
+					rel++;
+				}
+			}
+			ones += rel;
+		}
+	}
+
+	size_t size() const {
+		return n;
+	}
+
+	/**
+	 * Number of bits set.
+	 */
+	size_t count() const {
+		return ones;
+	}
+
+	size_t bytes() const {
+		return blockCount * blockWords * sizeof(uint64_t);
+	}
+
+	/**
+	 * Address of the block containing bit i, e.g. for prefetching.
+	 */
+	const void *address(size_t i) const {
+		size_t j;
+		return locate(i, j);
+	}
+
+	bool get(size_t i) const {
+		checkIndex(i);
+		size_t j, w, b;
+		const uint64_t *block = locate(i, j);
+		position(j, w, b);
+		return (block[w] >> b) & 1;
+	}
+
+	/**
+	 * Number of bits set in [0,i).
+	 */
+	uint32_t rank(size_t i) const {
+		size_t j, w, b;
+		const uint64_t *block = locate(i, j);
+		position(j, w, b);
+		uint64_t r = block[0] & HEADER;
+		if (overhead == OVERHEAD_25) {
+			if (w > 2) {
+				r += (block[1] >> (REL_BITS * (w - 3))) & lowMask(REL_BITS);
+			}
+		} else {
+			r += __builtin_popcountll(block[0] & ~HEADER & lowMask(w > 0 ? 64 : b));
+			for (size_t k = 1; k < w; k++) {
+				r += __builtin_popcountll(block[k]);
+			}
+		}
+		if (w > 0) {
+			r += __builtin_popcountll(block[w] & lowMask(b));
+		}
+		return (uint32_t)r;
+	}
+};
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMDHASH_X86 1
+#endif
+
+/**
+ * Jenkins one-at-a-time hashes of several keys computed in lockstep.
+ *
+ * The input is transposed: in[i*LANES + l] is the preprocessed
+ * character i of the key in lane l. Lanes with shorter keys keep their
+ * state once their length is reached. Keys must be shorter than 2^31.
+ */
+class JenkinsLanes {
+public:
+	using size_t = std::size_t;
+	using uint32_t = std::uint32_t;
+
+	static constexpr size_t LANES = 16;
+
+	using impl_t = void (*)(uint32_t *h, const uint32_t *in,
+			const uint32_t *len, size_t maxlen);
+
+private:
+	static void finish(uint32_t &hash) {
+		hash += hash << 3;
+		hash ^= hash >> 11;
+		hash += hash << 15;
+	}
+
+	static void runScalar(uint32_t *h, const uint32_t *in,
+			const uint32_t *len, size_t maxlen) {
+		for (size_t l=0; l<LANES; l++) {
+			uint32_t hash = h[l];
+			for (size_t i=0; i<len[l]; i++) {
+				hash += in[i*LANES + l];
+				hash += hash << 10;
+				hash ^= hash >> 6;
+			}
+			finish(hash);
+			h[l] = hash;
+		}
+		(void)maxlen;
+	}
+
+#ifdef SIMDHASH_X86
+	__attribute__((target("sse4.1")))
+	static void runSSE41(uint32_t *h, const uint32_t *in,
+			const uint32_t *len, size_t maxlen) {
+		// four independent vectors hide the latency of the dependency chain
+		const size_t V = LANES / 4;
+		__m128i hash[V];
+		__m128i vlen[V];
+		for (size_t v=0; v<V; v++) {
+			hash[v] = _mm_loadu_si128((const __m128i *)(h + 4*v));
+			vlen[v] = _mm_loadu_si128((const __m128i *)(len + 4*v));
+		}
+		for (size_t i=0; i<maxlen; i++) {
+			__m128i vi = _mm_set1_epi32((int)i);
+			for (size_t v=0; v<V; v++) {
+				__m128i active = _mm_cmpgt_epi32(vlen[v], vi);
+				__m128i c = _mm_loadu_si128((const __m128i *)(in + i*LANES + 4*v));
+				__m128i x = _mm_add_epi32(hash[v], c);
+				x = _mm_add_epi32(x, _mm_slli_epi32(x, 10));
+				x = _mm_xor_si128(x, _mm_srli_epi32(x, 6));
+				hash[v] = _mm_blendv_epi8(hash[v], x, active);
+			}
+		}
+		for (size_t v=0; v<V; v++) {
+			__m128i x = hash[v];
+			x = _mm_add_epi32(x, _mm_slli_epi32(x, 3));
+			x = _mm_xor_si128(x, _mm_srli_epi32(x, 11));
+			x = _mm_add_epi32(x, _mm_slli_epi32(x, 15));
+			_mm_storeu_si128((__m128i *)(h + 4*v), x);
+		}
+	}
+
+	__attribute__((target("avx2")))
+	static void runAVX2(uint32_t *h, const uint32_t *in,
+			const uint32_t *len, size_t maxlen) {
+		// two independent vectors hide the latency of the dependency chain
+		const size_t V = LANES / 8;
+		__m256i hash[V];
+		__m256i vlen[V];
+		for (size_t v=0; v<V; v++) {
+			hash[v] = _mm256_loadu_si256((const __m256i *)(h + 8*v));
+			vlen[v] = _mm256_loadu_si256((const __m256i *)(len + 8*v));
+		}
+		for (size_t i=0; i<maxlen; i++) {
+			__m256i vi = _mm256_set1_epi32((int)i);
+			for (size_t v=0; v<V; v++) {
+				__m256i active = _mm256_cmpgt_epi32(vlen[v], vi);
+				__m256i c = _mm256_loadu_si256((const __m256i *)(in + i*LANES + 8*v));
+				__m256i x = _mm256_add_epi32(hash[v], c);
+				x = _mm256_add_epi32(x, _mm256_slli_epi32(x, 10));
+				x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 6));
+				hash[v] = _mm256_blendv_epi8(hash[v], x, active);
+			}
+		}
+		for (size_t v=0; v<V; v++) {
+			__m256i x = hash[v];
+			x = _mm256_add_epi32(x, _mm256_slli_epi32(x, 3));
+			x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 11));
+			x = _mm256_add_epi32(x, _mm256_slli_epi32(x, 15));
+			_mm256_storeu_si256((__m256i *)(h + 8*v), x);
+		}
+	}
+#endif
+
+	static impl_t select() {
+#ifdef SIMDHASH_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) {
+			return runAVX2;
+		}
+		if (__builtin_cpu_supports("sse4.1")) {
+			return runSSE41;
+		}
+#endif
+		return runScalar;
+	}
+
+public:
+	/**
+	 * Implementation for the CPU we are running on.
+	 */
+	static impl_t impl() {
+		static const impl_t r = select();
+		return r;
+	}
+
+	/**
+	 * @param h initial state (seed) of each lane, receives the hashes
+	 * @param in transposed preprocessed characters
+	 * @param len key length of each lane
+	 * @param maxlen maximum of len
+	 */
+	static void run(uint32_t *h, const uint32_t *in,
+			const uint32_t *len, size_t maxlen) {
+		impl()(h, in, len, maxlen);
+	}
+};
@@ -0,0 +1,263 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <memory>
+
+#include "randtools.hpp"
+#include "hashtools.hpp"
+#include "bitarray.hpp"
+#include "hypergraph.hpp"
+#include "buildcontext.hpp"
+#include "buildstats.hpp"
+#include "algo.hpp"
+
+/**
+ * A static function (retrieval data structure) that maps each key of
+ * a map to its R bit value without storing the keys. Keys that are not
+ * in the map yield arbitrary values.
+ *
+ * Like AlgoBDZ3, each key is an edge of a 3-hypergraph with n nodes in
+ * each of three parts. If the hypergraph can be peeled, the nodes are
+ * assigned R bit values in reverse order of removal, such that
+ * g[h1] ^ g[h2] ^ g[h3] is the value of the key.
+ *
+ * Space is 3n * R bits, i.e., about 1.23 * R bits per key.
+ * For 10000 words with 4 bit values:
+ * 4100 * 3 * 4/8 = 6150 bytes
+ */
+template <unsigned R>
+class StaticFunction {
+	static_assert(R > 0 && R <= PackedArray::MAX_WIDTH, "invalid value width");
+
+private:
+	using string = std::string;
+	using size_t = std::size_t;
+	using vector = std::pmr::vector<size_t>;
+	using graph_t = Hypergraph<3>;
+	using edge_t = graph_t::edge_t;
+
+	unsigned folding = FOLD_NONE;
+	size_t depth = 32;
+	BuildContext context;
+	BuildContext *ctx = &context;
+	BuildStats noStats { false };
+	BuildStats *stats = &noStats;
+	TrialSeeds trialSeeds;
+
+	// the generated function
+	std::unique_ptr<HashFuncs<3>> funcs;
+	uint32_t n = 0;
+	FastMod fm;
+	PackedArray g;
+
+	uint64_t combine(uint32_t h1, uint32_t h2, uint32_t h3) const {
+		return g.get(h1) ^ g.get(h2) ^ g.get(h3);
+	}
+
+	/**
+	 * Assign values to nodes in reverse order of removal, such that
+	 * the values of each edge's nodes XOR to the value of the edge.
+	 * The node removed with an edge is still zero when it is assigned.
+	 */
+	void assign(const graph_t &gr, const vector &seq, const vector &nodes,
+			const std::pmr::vector<uint64_t> &vals) {
+		g.assign(gr.getN(), R);
+		for (size_t i = seq.size(); i-- > 0; ) {
+			const edge_t &e = gr.getEdge(seq[i]);
+			uint64_t x = g.get(e[0]) ^ g.get(e[1]) ^ g.get(e[2]);
+			g.set(nodes[i], vals[seq[i]] ^ x);
+		}
+	}
+
+public:
+	static constexpr size_t BATCH = 256;
+	static constexpr unsigned BITS = R;
+
+	/**
+	 * Set the character folding (FOLD_* flags) applied by the hash functions.
+	 */
+	void setFolding(unsigned flags) {
+		folding = flags;
+	}
+
+	/**
+	 * Set the number of keys whose g values are prefetched together
+	 * by lookupBatch, at most BATCH.
+	 */
+	void setPrefetchDepth(size_t d) {
+		if (d == 0 || d > BATCH) {
+			throw std::runtime_error("invalid prefetch depth");
+		}
+		depth = d;
+	}
+
+	/**
+	 * Take the scratch memory of builds from a context that may be
+	 * shared with other algorithms, instead of an own one.
+	 */
+	void setBuildContext(BuildContext &c) {
+		ctx = &c;
+	}
+
+	BuildContext &getBuildContext() {
+		return *ctx;
+	}
+
+	/**
+	 * Report the trials, failures and phase times of runs to s.
+	 */
+	void setStats(BuildStats &s) {
+		stats = &s;
+	}
+
+	/**
+	 * Seeds of the trials, for reproducible builds.
+	 */
+	TrialSeeds &getTrialSeeds() {
+		return trialSeeds;
+	}
+
+	double factor_init() {
+		return 0.40;
+	}
+	/**
+	 * Load factor n/m below which runs (almost) never succeed.
+	 */
+	double factor_min(size_t m) {
+		(void)m;
+		// peelability threshold of random 3-hypergraphs, per part
+		return 1.2219 / 3;
+	}
+	double factor_inc() {
+		return 1.02;
+	}
+
+	bool run(randgen_t &randgen, const map_t &map,
+			size_t maxlen, uint32_t n, size_t trials) {
+		(void)maxlen;
+		ctx->reset();
+		stats->beginRun(map.size(), n);
+		Trace::Scope scope("StaticFunction::run", "n", n);
+
+		// edge i is the i-th key of the map
+		std::pmr::vector<uint64_t> vals(ctx);
+		vals.reserve(map.size());
+		for (auto &x : map) {
+			if (PackedArray::bitsFor(x.second) > R) {
+				throw std::runtime_error("value too large for static function");
+			}
+			vals.push_back(x.second);
+		}
+
+		graph_t g(3 * (size_t)n, map.size(), ctx);
+		vector edgeSeq(ctx);
+		vector nodeSeq(ctx);
+		edgeSeq.reserve(map.size());
+		nodeSeq.reserve(map.size());
+
+		this->n = 0;
+		RandRange rs32Bit(randgen, 0, UINT32_MAX);
+		funcs = std::make_unique<HashFuncs<3>>(folding, rs32Bit);
+		auto &hf1 = funcs->hf[0];
+		auto &hf2 = funcs->hf[1];
+		auto &hf3 = funcs->hf[2];
+
+		for (size_t i=0; i<trials; i++) {
+			trialSeeds.reseed(randgen, n, i);
+			funcs->randomize();
+			g.clear();
+			stats->trial();
+
+			auto t = stats->now();
+			for (auto &x : map) {
+				const string &key = x.first;
+				uint32_t h1 = hf1.hash(key) % n + 0 * n;
+				uint32_t h2 = hf2.hash(key) % n + 1 * n;
+				uint32_t h3 = hf3.hash(key) % n + 2 * n;
+				g.addEdge(edge_t { h1, h2, h3 });
+			}
+
+			stats->phase(BuildStats::PHASE_HASH, t);
+
+			t = stats->now();
+			edgeSeq.clear();
+			nodeSeq.clear();
+			size_t mc = g.peel(edgeSeq, nodeSeq);
+			stats->phase(BuildStats::PHASE_PEEL, t);
+			if (mc != map.size()) {
+				stats->failure(BuildStats::NOT_PEELABLE);
+				stats->core(map.size() - mc);
+				continue;
+			}
+
+			t = stats->now();
+			assign(g, edgeSeq, nodeSeq, vals);
+			stats->phase(BuildStats::PHASE_ASSIGN, t);
+
+			size_t eidx = 0;
+			for (auto &x : map) {
+				(void)x;
+				const edge_t &e = g.getEdge(eidx);
+				if (combine(e[0], e[1], e[2]) != vals[eidx]) {
+					throw std::runtime_error("sanity check failed");
+				}
+				eidx++;
+			}
+
+			this->n = n;
+			fm = FastMod(n);
+			stats->endRun(true);
+			return true;
+		}
+		stats->endRun(false);
+		return false;
+	}
+
+	/**
+	 * Size of the g values in bytes.
+	 */
+	size_t bytes() const {
+		return g.bytes();
+	}
+
+	/**
+	 * Evaluate the function found by the last successful run.
+	 * @return the value of the key if it is in the map
+	 */
+	uint64_t lookup(const string &key) {
+		uint32_t h1 = fm.mod(funcs->hf[0].hash(key)) + 0 * n;
+		uint32_t h2 = fm.mod(funcs->hf[1].hash(key)) + 1 * n;
+		uint32_t h3 = fm.mod(funcs->hf[2].hash(key)) + 2 * n;
+		return combine(h1, h2, h3);
+	}
+
+	/**
+	 * Evaluate the function for several keys, out[i] receives lookup(keys[i]).
+	 * Blocks of keys are hashed first and their g values are prefetched
+	 * before any of them is combined.
+	 */
+	void lookupBatch(const string *keys, size_t count, uint64_t *out) {
+		uint32_t h1[BATCH];
+		uint32_t h2[BATCH];
+		uint32_t h3[BATCH];
+		for (size_t b=0; b<count; b+=depth) {
+			size_t k = std::min(depth, count - b);
+			funcs->hf[0].hashBatch(keys + b, k, h1);
+			funcs->hf[1].hashBatch(keys + b, k, h2);
+			funcs->hf[2].hashBatch(keys + b, k, h3);
+			for (size_t i=0; i<k; i++) {
+				h1[i] = fm.mod(h1[i]) + 0 * n;
+				h2[i] = fm.mod(h2[i]) + 1 * n;
+				h3[i] = fm.mod(h3[i]) + 2 * n;
+				__builtin_prefetch(g.address(h1[i]));
+				__builtin_prefetch(g.address(h2[i]));
+				__builtin_prefetch(g.address(h3[i]));
+			}
+			for (size_t i=0; i<k; i++) {
+				out[b+i] = combine(h1[i], h2[i], h3[i]);
+			}
+		}
+	}
+};
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include "randtools.hpp"
+#include "bitarray.hpp"
+#include "fingerprints.hpp"
+#include "algo.hpp"
+
+/**
+ * A static map from strings to integers built on top of a minimal
+ * perfect hash function F (e.g., AlgoBDZ2, AlgoBDZ3, or AlgoCHD).
+ *
+ * The values (any uint64_t) are stored in a bit-packed column indexed
+ * by the minimal perfect hash function. If there are only few distinct
+ * values, they are dictionary encoded: the column stores indices into
+ * a sorted array of the distinct values.
+ *
+ * Optionally, a fingerprint of each key is stored (see Fingerprints),
+ * so that most keys that are not in the map are rejected by find().
+ */
+template <class F>
+class StaticMap {
+public:
+	using string = std::string;
+	using size_t = std::size_t;
+	using uint64_t = std::uint64_t;
+
+private:
+	F &f;
+	size_t m = 0;
+	std::unique_ptr<Fingerprints<F>> fps;
+	PackedArray values;
+	std::vector<uint64_t> dict;
+
+	uint64_t value(size_t i) const {
+		uint64_t v = values.get(i);
+		return dict.empty() ? v : dict[v];
+	}
+
+public:
+	/**
+	 * @param f minimal perfect hash function, must outlive the map
+	 */
+	StaticMap(F &f) : f(f) {
+		// nothing
+	}
+
+	/**
+	 * Build the map, f must have been built for the keys of map.
+	 * @param folding the character folding used by f
+	 * @param fpBits bits per fingerprint: 0 (none) or 4 to 16
+	 */
+	void build(randgen_t &randgen, const map_t &map, unsigned folding, unsigned fpBits) {
+		m = map.size();
+
+		// find distinct values
+		dict.clear();
+		for (auto &x : map) {
+			dict.push_back(x.second);
+		}
+		std::sort(dict.begin(), dict.end());
+		dict.erase(std::unique(dict.begin(), dict.end()), dict.end());
+
+		// use dictionary encoding only if it saves space
+		uint64_t maxval = dict.empty() ? 0 : dict.back();
+		size_t plainBits = m * PackedArray::bitsFor(maxval);
+		size_t dictBits = m * PackedArray::bitsFor(dict.empty() ? 0 : dict.size() - 1)
+				+ dict.size() * 64;
+		if (dictBits < plainBits) {
+			values.assign(m, PackedArray::bitsFor(dict.size() - 1));
+			for (auto &x : map) {
+				auto it = std::lower_bound(dict.begin(), dict.end(), x.second);
+				values.set(f.lookup(x.first), (uint64_t)(it - dict.begin()));
+			}
+		} else {
+			dict.clear();
+			values.assign(m, PackedArray::bitsFor(maxval));
+			for (auto &x : map) {
+				values.set(f.lookup(x.first), x.second);
+			}
+		}
+
+		if (fpBits > 0) {
+			fps = std::make_unique<Fingerprints<F>>(f);
+			fps->build(randgen, map, folding, fpBits);
+		} else {
+			fps.reset();
+		}
+	}
+
+	/**
+	 * Whether the values are dictionary encoded.
+	 */
+	bool isDictEncoded() const {
+		return !dict.empty();
+	}
+
+	/**
+	 * Size of the value and fingerprint columns in bytes.
+	 */
+	size_t bytes() const {
+		return values.bytes() + (fps ? fps->bytes() : 0) + dict.size() * sizeof(uint64_t);
+	}
+
+	/**
+	 * The value of a key that is known to be in the map.
+	 */
+	uint64_t get(const string &key) {
+		return value(f.lookup(key));
+	}
+
+	/**
+	 * Look up the value of a key that may not be in the map.
+	 * Without fingerprints, every key is reported as found.
+	 * @return false if the key is definitely not in the map
+	 */
+	bool find(const string &key, uint64_t &v) {
+		size_t i;
+		if (fps) {
+			if (!fps->find(key, i)) {
+				return false;
+			}
+		} else {
+			i = f.lookup(key);
+			if (i >= m) {
+				return false;
+			}
+		}
+		v = value(i);
+		return true;
+	}
+};
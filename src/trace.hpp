@@ -0,0 +1,185 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+
+#include <json/json.h>
+
+/**
+ * Timeline of a construction in the Chrome trace format, which
+ * chrome://tracing and Perfetto display.
+ *
+ * Scopes record complete events (name, start, duration) with the
+ * thread that ran them. They go to the trace that was activated with
+ * activate(), and cost a load and a branch while no trace is active.
+ */
+class Trace {
+public:
+	using size_t = std::size_t;
+	using uint32_t = std::uint32_t;
+	using clock = std::chrono::steady_clock;
+
+private:
+	struct Event {
+		const char *name;
+		std::string args;
+		uint32_t tid;
+		clock::time_point start;
+		clock::time_point end;
+	};
+
+	inline static std::atomic<Trace *> current { nullptr };
+
+	// ids of running threads, reused after a thread exits so that the
+	// workers of successive parallel loops share rows in the viewer
+	inline static std::mutex tidMutex;
+	inline static std::vector<bool> tidUsed;
+
+	struct ThreadSlot {
+		uint32_t id = 0;
+
+		ThreadSlot() {
+			std::lock_guard<std::mutex> lock(tidMutex);
+			while (id < tidUsed.size() && tidUsed[id]) {
+				id++;
+			}
+			if (id == tidUsed.size()) {
+				tidUsed.push_back(false);
+			}
+			tidUsed[id] = true;
+		}
+
+		~ThreadSlot() {
+			std::lock_guard<std::mutex> lock(tidMutex);
+			tidUsed[id] = false;
+		}
+	};
+
+	std::mutex mutex;
+	std::vector<Event> events;
+	clock::time_point origin = clock::now();
+
+public:
+	/**
+	 * Record a complete event from construction to destruction.
+	 */
+	class Scope {
+	private:
+		Trace *trace;
+		const char *name;
+		std::string args;
+		clock::time_point start;
+
+	public:
+		/**
+		 * @param name must outlive the trace, usually a literal
+		 * @param args shown with the event, for example "n=1000"
+		 */
+		Scope(const char *name, std::string args = std::string())
+				: trace(active()), name(name) {
+			if (trace) {
+				this->args = std::move(args);
+				start = clock::now();
+			}
+		}
+
+		/**
+		 * Scope with the argument "key=value", formatted only if tracing.
+		 */
+		Scope(const char *name, const char *key, uint64_t value)
+				: trace(active()), name(name) {
+			if (trace) {
+				args = std::string(key) + "=" + std::to_string(value);
+				start = clock::now();
+			}
+		}
+
+		Scope(const Scope &) = delete;
+		Scope &operator=(const Scope &) = delete;
+
+		~Scope() {
+			if (trace) {
+				trace->add(name, std::move(args), start, clock::now());
+			}
+		}
+	};
+
+	Trace() {
+		// nothing
+	}
+
+	Trace(const Trace &) = delete;
+	Trace &operator=(const Trace &) = delete;
+
+	~Trace() {
+		deactivate();
+	}
+
+	static Trace *active() {
+		return current.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * Record the scopes of all threads in this trace.
+	 */
+	void activate() {
+		current.store(this);
+	}
+
+	void deactivate() {
+		Trace *self = this;
+		current.compare_exchange_strong(self, nullptr);
+	}
+
+	/**
+	 * Smallest id that no other running thread has.
+	 */
+	static uint32_t threadId() {
+		thread_local ThreadSlot slot;
+		return slot.id;
+	}
+
+	void add(const char *name, std::string args, clock::time_point start, clock::time_point end) {
+		uint32_t tid = threadId();
+		std::lock_guard<std::mutex> lock(mutex);
+		events.push_back(Event { name, std::move(args), tid, start, end });
+	}
+
+	size_t size() const {
+		return events.size();
+	}
+
+	Json::Value toJSON() const {
+		auto micros = [this](clock::time_point t) {
+			return std::chrono::duration<double, std::micro>(t - origin).count();
+		};
+		Json::Value root(Json::objectValue);
+		Json::Value &evs = root["traceEvents"] = Json::Value(Json::arrayValue);
+		for (auto &e : events) {
+			Json::Value x(Json::objectValue);
+			x["name"] = e.name;
+			x["ph"] = "X";
+			x["pid"] = 1;
+			x["tid"] = e.tid;
+			x["ts"] = micros(e.start);
+			x["dur"] = micros(e.end) - micros(e.start);
+			if (!e.args.empty()) {
+				x["args"]["detail"] = e.args;
+			}
+			evs.append(x);
+		}
+		root["displayTimeUnit"] = "ms";
+		return root;
+	}
+
+	void write(std::ostream &out) const {
+		Json::StreamWriterBuilder builder;
+		builder["indentation"] = "";
+		out << Json::writeString(builder, toJSON()) << std::endl;
+	}
+};
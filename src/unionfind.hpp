@@ -1,25 +1,29 @@
 #pragma once
 
-#include <memory>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <memory_resource>
+#include <stdexcept>
 
+/**
+ * Union find with 32 bit parent indexes (4 bytes per node).
+ * Roots are linked by index and finds halve the path they follow.
+ * The parents may come from a BuildContext.
+ */
 class UnionFind {
 public:
 	using size_t = std::size_t;
+	using uint32_t = std::uint32_t;
 private:
-	struct node_t {
-		/**
-		 * Size of the tree rooted at this node.
-		 */
-		size_t s;
-		/**
-		 * Index of the parent node.
-		 * Roots have themselves as a parent.
-		 */
-		size_t p;
-	} ;
-
 	const size_t n;
-	std::unique_ptr<node_t[]> nodes;
+	/**
+	 * Index of the parent node.
+	 * Roots have themselves as a parent.
+	 */
+	std::pmr::vector<uint32_t> parents;
+	// longest path followed by a find since clear()
+	uint32_t depth = 0;
 
 	void checkIndex(size_t x) const {
 		if (x >= n) {
@@ -27,9 +31,27 @@ private:
 		}
 	}
 
+	/**
+	 * Find the root without checking the index, halving the path.
+	 */
+	uint32_t find(uint32_t i) {
+		uint32_t d = 0;
+		while (parents[i] != i) {
+			parents[i] = parents[parents[i]];
+			i = parents[i];
+			d++;
+		}
+		depth = std::max(depth, d);
+		return i;
+	}
+
 public:
-	UnionFind(size_t n) : n(n) {
-		nodes = std::make_unique<node_t[]>(n);
+	UnionFind(size_t n, std::pmr::memory_resource *mr = std::pmr::get_default_resource()) :
+			n(n), parents(mr) {
+		if (n > UINT32_MAX) {
+			throw std::runtime_error("too many nodes");
+		}
+		parents.resize(n);
 		clear();
 	}
 
@@ -43,46 +65,41 @@ public:
 
 	void clear() {
 		for (size_t i = 0; i<n; i++) {
-			nodes[i].s = 1;
-			nodes[i].p = i;
+			parents[i] = (uint32_t)i;
 		}
+		depth = 0;
+	}
+
+	/**
+	 * Number of steps of the longest find since clear(), each step halves
+	 * the path. Kept while finding, so reading it costs nothing.
+	 */
+	size_t maxDepth() const {
+		return depth;
 	}
 
-	size_t findIdentity(size_t i) const {
+	size_t findIdentity(size_t i) {
 		checkIndex(i);
-		// find root
-		size_t r = i;
-		while (nodes[r].p != r) {
-			r = nodes[r].p;
-		}
-		// path compression
-		while (nodes[i].p != r) {
-			size_t p = nodes[i].p;
-			nodes[i].p = r;
-			i = p;
-		}
-		return r;
+		return find((uint32_t)i);
 	}
 
 	bool doUnion(size_t i, size_t j) {
-		size_t ri = findIdentity(i);
-		size_t rj = findIdentity(j);
+		if (i >= n || j >= n) {
+			throw std::runtime_error("invalid index");
+		}
+		uint32_t ri = find((uint32_t)i);
+		uint32_t rj = find((uint32_t)j);
 		if (ri == rj) {
 			return true;
 		}
-		auto &ni = nodes[ri];
-		auto &nj = nodes[rj];
-		// union by size (smaller tree is added to bigger tree)
-		if (ni.s >= nj.s) {
-			ni.s += nj.s;
-			nj.p = ri;
+		// union by index (the root with the smaller index is added to the
+		// other tree), which needs no rank and for hashed node indexes
+		// is as good as randomized linking
+		if (ri < rj) {
+			parents[ri] = rj;
 		} else {
-			nj.s += ni.s;
-			ni.p = rj;
+			parents[rj] = ri;
 		}
 		return false;
 	}
 };
-
-
-
@@ -1,16 +1,21 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
+#include <utility>
+#include <stdexcept>
 
+/**
+ * Union find that stores a value for each set, with 32 bit parent
+ * indexes (16 bytes per node). Roots are linked by index and finds
+ * halve the path they follow.
+ */
 class UnionFind2 {
 public:
 	using size_t = std::size_t;
+	using uint32_t = std::uint32_t;
 private:
 	struct node_t {
-		/**
-		 * Size of the tree rooted at this node.
-		 */
-		size_t s;
 		/**
 		 * Value stored for the tree root.
 		 */
@@ -19,7 +24,7 @@ private:
 		 * Index of the parent node.
 		 * Roots have themselves as a parent.
 		 */
-		size_t p;
+		uint32_t p;
 	} ;
 
 	const size_t n;
@@ -31,8 +36,22 @@ private:
 		}
 	}
 
+	/**
+	 * Find the root without checking the index, halving the path.
+	 */
+	uint32_t find(uint32_t i) {
+		while (nodes[i].p != i) {
+			nodes[i].p = nodes[nodes[i].p].p;
+			i = nodes[i].p;
+		}
+		return i;
+	}
+
 public:
 	UnionFind2(size_t n) : n(n) {
+		if (n > UINT32_MAX) {
+			throw std::runtime_error("too many nodes");
+		}
 		nodes = std::make_unique<node_t[]>(n);
 		clear();
 	}
@@ -48,26 +67,14 @@ public:
 	void clear() {
 		for (size_t i = 0; i<n; i++) {
 			node_t &n = nodes[i];
-			n.s = 1;
 			n.v = 0;
-			n.p = i;
+			n.p = (uint32_t)i;
 		}
 	}
 
-	size_t findIdentity(size_t i) const {
+	size_t findIdentity(size_t i) {
 		checkIndex(i);
-		// find root
-		size_t r = i;
-		while (nodes[r].p != r) {
-			r = nodes[r].p;
-		}
-		// path compression
-		while (nodes[i].p != r) {
-			size_t p = nodes[i].p;
-			nodes[i].p = r;
-			i = p;
-		}
-		return r;
+		return find((uint32_t)i);
 	}
 
 	size_t adjustValue(size_t i, size_t add, size_t sub) {
@@ -77,26 +84,21 @@ public:
 	}
 
 	bool doUnion(size_t i, size_t j) {
-		size_t ri = findIdentity(i);
-		size_t rj = findIdentity(j);
+		if (i >= n || j >= n) {
+			throw std::runtime_error("invalid index");
+		}
+		uint32_t ri = find((uint32_t)i);
+		uint32_t rj = find((uint32_t)j);
 		if (ri == rj) {
 			return true;
 		}
-		auto &ni = nodes[ri];
-		auto &nj = nodes[rj];
-		// union by size (smaller tree is added to bigger tree)
-		if (ni.s >= nj.s) {
-			ni.s += nj.s;
-			ni.v += nj.v;
-			nj.p = ri;
-		} else {
-			nj.s += ni.s;
-			nj.v += ni.v;
-			ni.p = rj;
+		// union by index (the root with the smaller index is added to the
+		// other tree)
+		if (ri < rj) {
+			std::swap(ri, rj);
 		}
+		nodes[ri].v += nodes[rj].v;
+		nodes[rj].p = ri;
 		return false;
 	}
 };
-
-
-
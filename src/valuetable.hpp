@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+#include <algorithm>
+
+#include "bitarray.hpp"
+#include "algo.hpp"
+
+/**
+ * The values of a map, stored at the positions given by a minimal
+ * perfect hash function. Each value takes as many bits as the largest
+ * value, i.e., ceil(log2 m) bits if the values are array indices, and
+ * at most 64 bits for arbitrary uint64_t values.
+ */
+class ValueTable {
+public:
+	using size_t = std::size_t;
+	using uint64_t = std::uint64_t;
+
+private:
+	PackedArray values;
+
+public:
+	/**
+	 * @param f minimal perfect hash function for the keys of map,
+	 *          f.lookup(key) must be in [0,map.size())
+	 */
+	template <class F>
+	void build(F &f, const map_t &map) {
+		uint64_t maxval = 0;
+		for (auto &x : map) {
+			maxval = std::max(maxval, (uint64_t)x.second);
+		}
+		values.assign(map.size(), PackedArray::bitsFor(maxval));
+		for (auto &x : map) {
+			values.set(f.lookup(x.first), x.second);
+		}
+	}
+
+	bool empty() const {
+		return values.size() == 0;
+	}
+
+	size_t bytes() const {
+		return values.bytes();
+	}
+
+	const void *address(size_t i) const {
+		return values.address(i);
+	}
+
+	uint64_t get(size_t i) const {
+		return values.get(i);
+	}
+};
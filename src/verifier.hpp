@@ -0,0 +1,193 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+
+#include "algo.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
+
+/**
+ * Verification of a finished function against all of its keys, after
+ * compression, with all threads.
+ *
+ * perfect() checks that the keys are mapped bijectively onto [0,m): every
+ * index is in range and none is taken twice, which an atomic bitmap of m
+ * bits detects without locks. values() checks that every key is mapped
+ * to its value (CHM, order preserving BDZ, StaticFunction).
+ *
+ * The threads share the buckets of the map, so the keys are not copied.
+ * The function is called concurrently and must not modify shared state,
+ * which holds for lookup() and lookupBatch() of the algorithms.
+ * Offending keys are collected up to a limit, all are counted.
+ */
+class Verifier {
+public:
+	using size_t = std::size_t;
+	using uint64_t = std::uint64_t;
+	using string = std::string;
+
+	enum Kind {
+		// index not in [0,m)
+		OUT_OF_RANGE,
+		// index of an earlier key
+		COLLISION,
+		// value differs from the map
+		WRONG_VALUE,
+		// the function threw
+		EXCEPTION
+	};
+
+	struct Offense {
+		Kind kind;
+		string key;
+		uint64_t got;
+		uint64_t expected;
+		string message;
+	};
+
+private:
+	unsigned threads = Parallel::hardwareThreads();
+	size_t maxOffenses = 16;
+
+	std::mutex mutex;
+	std::atomic<size_t> errors { 0 };
+	std::vector<Offense> offenses;
+
+	void report(Kind kind, const string &key, uint64_t got, uint64_t expected,
+			const char *message = "") {
+		if (errors.fetch_add(1, std::memory_order_relaxed) >= maxOffenses) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		offenses.push_back(Offense { kind, key, got, expected, message });
+	}
+
+	/**
+	 * Call check(key, value) for all entries of map, with the buckets
+	 * split among the threads.
+	 */
+	template <class C>
+	void forAll(const map_t &map, C &&check) {
+		errors = 0;
+		offenses.clear();
+		Parallel::forRange(threads, map.bucket_count(), [&](size_t b, size_t e, unsigned tid) {
+			(void)tid;
+			for (size_t i=b; i<e; i++) {
+				for (auto it = map.begin(i); it != map.end(i); ++it) {
+					try {
+						check(it->first, it->second);
+					} catch (std::exception &ex) {
+						report(EXCEPTION, it->first, 0, 0, ex.what());
+					}
+				}
+			}
+		});
+	}
+
+public:
+	Verifier() {
+		// nothing
+	}
+
+	/**
+	 * Set the number of threads, 0 or 1 for the calling thread only.
+	 */
+	void setThreads(unsigned t) {
+		threads = t;
+	}
+
+	/**
+	 * Set the number of offending keys that are kept for getOffenses().
+	 */
+	void setMaxOffenses(size_t max) {
+		maxOffenses = max;
+	}
+
+	/**
+	 * Check that f maps the keys of map bijectively onto [0,m).
+	 * @param f index of a key, for example the lookup of an algorithm
+	 */
+	template <class F>
+	bool perfect(const map_t &map, F &&f) {
+		Trace::Scope scope("verify", "keys", map.size());
+		size_t m = map.size();
+		std::vector<std::atomic<uint64_t>> bits((m + 63) / 64);
+		for (auto &w : bits) {
+			w.store(0, std::memory_order_relaxed);
+		}
+		forAll(map, [&](const string &key, uint64_t value) {
+			(void)value;
+			uint64_t idx = (uint64_t)f(key);
+			if (idx >= m) {
+				report(OUT_OF_RANGE, key, idx, m);
+				return;
+			}
+			uint64_t bit = (uint64_t)1 << (idx % 64);
+			if (bits[idx / 64].fetch_or(bit, std::memory_order_relaxed) & bit) {
+				report(COLLISION, key, idx, idx);
+			}
+		});
+		return errors == 0;
+	}
+
+	/**
+	 * Check that f maps every key of map to its value.
+	 */
+	template <class F>
+	bool values(const map_t &map, F &&f) {
+		Trace::Scope scope("verify", "keys", map.size());
+		forAll(map, [&](const string &key, uint64_t value) {
+			uint64_t got = (uint64_t)f(key);
+			if (got != value) {
+				report(WRONG_VALUE, key, got, value);
+			}
+		});
+		return errors == 0;
+	}
+
+	/**
+	 * Number of offending keys of the last verification.
+	 */
+	size_t getErrors() const {
+		return errors;
+	}
+
+	/**
+	 * The first offending keys of the last verification (in no
+	 * particular order with threads).
+	 */
+	const std::vector<Offense> &getOffenses() const {
+		return offenses;
+	}
+
+	void write(std::ostream &out) const {
+		static const char *names[] = {
+			"out of range", "collision", "wrong value", "exception"
+		};
+		out << getErrors() << " offending keys" << std::endl;
+		for (auto &o : offenses) {
+			out << "\"" << o.key << "\": " << names[o.kind];
+			switch (o.kind) {
+			case OUT_OF_RANGE:
+				out << ", index " << o.got << " >= " << o.expected;
+				break;
+			case COLLISION:
+				out << ", index " << o.got << " taken";
+				break;
+			case WRONG_VALUE:
+				out << ", got " << o.got << " instead of " << o.expected;
+				break;
+			case EXCEPTION:
+				out << ", " << o.message;
+				break;
+			}
+			out << std::endl;
+		}
+	}
+};
@@ -0,0 +1,248 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <memory>
+
+#include "randtools.hpp"
+#include "hashtools.hpp"
+#include "bitarray.hpp"
+#include "hypergraph.hpp"
+#include "fuse.hpp"
+#include "buildcontext.hpp"
+#include "algo.hpp"
+
+/**
+ * Approximate membership filter for the keys of a map (the values are
+ * ignored). Keys in the map are always found, other keys are found
+ * with a probability of about 2^-BITS.
+ *
+ * Each key is an edge of a 3-hypergraph. After peeling, the nodes are
+ * assigned BITS bit values in reverse order of removal, such that
+ * g[h1] ^ g[h2] ^ g[h3] is the fingerprint of the key (Graf and Lemire,
+ * Xor Filters).
+ *
+ * With FUSE, the hypergraph is spatially coupled (see FuseLayout):
+ * it needs about 1.125 instead of 1.23 nodes per key, and the three
+ * nodes of a key lie in a window of three consecutive segments
+ * (Binary Fuse Filters).
+ *
+ * Space for 10000 words with 8 bit fingerprints:
+ * xor:  (1.23 * 10000 + 32) * 8/8 = 12332 bytes
+ * fuse: 25 segments of 512 nodes * 8/8 = 12800 bytes
+ * Fuse filters reach 1.125 nodes (9 bits) per key only for about
+ * 10^6 keys and more, small ones need more space than xor filters.
+ */
+template <unsigned BITS, bool FUSE>
+class XorFilter {
+	static_assert(BITS > 0 && BITS <= 32, "invalid fingerprint width");
+
+private:
+	using string = std::string;
+	using size_t = std::size_t;
+	using vector = std::pmr::vector<size_t>;
+	using graph_t = Hypergraph<3>;
+	using edge_t = graph_t::edge_t;
+
+	unsigned folding = FOLD_NONE;
+	size_t depth = 32;
+	BuildContext context;
+	BuildContext *ctx = &context;
+
+	// the generated filter, hf[3] yields the fingerprint
+	std::unique_ptr<HashFuncs<4>> funcs;
+	uint32_t n = 0;
+	FastMod fm;
+	FuseLayout layout;
+	PackedArray g;
+
+	static uint64_t fingerprint(uint32_t h4) {
+		return h4 >> (32 - BITS);
+	}
+
+	/**
+	 * The nodes of a key from its first three hashes.
+	 */
+	void nodes(uint32_t &h1, uint32_t &h2, uint32_t &h3) const {
+		if (FUSE) {
+			layout.nodes(h1, FuseLayout::mix(h2, h3), h1, h2, h3);
+		} else {
+			h1 = fm.mod(h1) + 0 * n;
+			h2 = fm.mod(h2) + 1 * n;
+			h3 = fm.mod(h3) + 2 * n;
+		}
+	}
+
+	uint64_t combine(uint32_t h1, uint32_t h2, uint32_t h3) const {
+		return g.get(h1) ^ g.get(h2) ^ g.get(h3);
+	}
+
+	/**
+	 * Assign values to nodes in reverse order of removal, such that
+	 * the values of each edge's nodes XOR to the edge's fingerprint.
+	 */
+	void assign(const graph_t &gr, const vector &seq, const vector &nodes,
+			const std::pmr::vector<uint64_t> &fps) {
+		g.assign(gr.getN(), BITS);
+		for (size_t i = seq.size(); i-- > 0; ) {
+			const edge_t &e = gr.getEdge(seq[i]);
+			uint64_t x = g.get(e[0]) ^ g.get(e[1]) ^ g.get(e[2]);
+			g.set(nodes[i], fps[seq[i]] ^ x);
+		}
+	}
+
+public:
+	static constexpr size_t BATCH = 256;
+
+	/**
+	 * Set the character folding (FOLD_* flags) applied by the hash functions.
+	 */
+	void setFolding(unsigned flags) {
+		folding = flags;
+	}
+
+	/**
+	 * Set the number of keys whose g values are prefetched together
+	 * by containsBatch, at most BATCH.
+	 */
+	void setPrefetchDepth(size_t d) {
+		if (d == 0 || d > BATCH) {
+			throw std::runtime_error("invalid prefetch depth");
+		}
+		depth = d;
+	}
+
+	/**
+	 * Take the scratch memory of builds from a context that may be
+	 * shared with other algorithms, instead of an own one.
+	 */
+	void setBuildContext(BuildContext &c) {
+		ctx = &c;
+	}
+
+	BuildContext &getBuildContext() {
+		return *ctx;
+	}
+
+	/**
+	 * Build the filter for the keys of map.
+	 * @param trials number of hash functions to try
+	 * @return false if no hypergraph could be peeled
+	 */
+	bool build(randgen_t &randgen, const map_t &map, size_t trials) {
+		size_t m = map.size();
+		size_t nodeCount;
+		ctx->reset();
+		if (FUSE) {
+			unsigned bits = FuseLayout::segmentBitsFor(m);
+			size_t len = (size_t)1 << bits;
+			size_t want = (size_t)((double)m * FuseLayout::sizeFactor(m));
+			// round up to whole segments, at least three
+			layout = FuseLayout(std::max((want + len - 1) / len, (size_t)3) * len, bits);
+			nodeCount = layout.size();
+		} else {
+			n = (uint32_t)(((size_t)(1.23 * (double)m) + 32 + 2) / 3);
+			fm = FastMod(n);
+			nodeCount = 3 * (size_t)n;
+		}
+
+		graph_t gr(nodeCount, m, ctx);
+		std::pmr::vector<uint64_t> fps(ctx);
+		fps.reserve(m);
+		vector edgeSeq(ctx);
+		vector nodeSeq(ctx);
+		edgeSeq.reserve(m);
+		nodeSeq.reserve(m);
+
+		RandRange rs32Bit(randgen, 0, UINT32_MAX);
+		funcs = std::make_unique<HashFuncs<4>>(folding, rs32Bit);
+		for (size_t i=0; i<trials; i++) {
+			funcs->randomize();
+			gr.clear();
+			fps.clear();
+
+			for (auto &x : map) {
+				const string &key = x.first;
+				uint32_t h1 = funcs->hf[0].hash(key);
+				uint32_t h2 = funcs->hf[1].hash(key);
+				uint32_t h3 = funcs->hf[2].hash(key);
+				nodes(h1, h2, h3);
+				gr.addEdge(edge_t { h1, h2, h3 });
+				fps.push_back(fingerprint(funcs->hf[3].hash(key)));
+			}
+
+			edgeSeq.clear();
+			nodeSeq.clear();
+			size_t mc = gr.peel(edgeSeq, nodeSeq);
+			if (mc != m) {
+				continue;
+			}
+
+			assign(gr, edgeSeq, nodeSeq, fps);
+			for (auto &x : map) {
+				if (!contains(x.first)) {
+					throw std::runtime_error("sanity check failed");
+				}
+			}
+			return true;
+		}
+		funcs.reset();
+		return false;
+	}
+
+	/**
+	 * Size of the fingerprint cells in bytes.
+	 */
+	size_t bytes() const {
+		return g.bytes();
+	}
+
+	/**
+	 * @return true if the key is in the map, or with probability
+	 *         about 2^-BITS if it is not
+	 */
+	bool contains(const string &key) const {
+		const HashFuncs<4> &f = *funcs;
+		uint32_t h1 = f.hf[0].hash(key);
+		uint32_t h2 = f.hf[1].hash(key);
+		uint32_t h3 = f.hf[2].hash(key);
+		nodes(h1, h2, h3);
+		return combine(h1, h2, h3) == fingerprint(f.hf[3].hash(key));
+	}
+
+	/**
+	 * Test several keys, out[i] receives contains(keys[i]).
+	 * Blocks of keys are hashed first and their cells are prefetched
+	 * before any of them is tested.
+	 */
+	void containsBatch(const string *keys, size_t count, bool *out) const {
+		uint32_t h1[BATCH];
+		uint32_t h2[BATCH];
+		uint32_t h3[BATCH];
+		uint32_t h4[BATCH];
+		// hashing is const, so concurrent calls do not interfere
+		const HashFuncs<4> &f = *funcs;
+		for (size_t b=0; b<count; b+=depth) {
+			size_t k = std::min(depth, count - b);
+			f.hf[0].hashBatch(keys + b, k, h1);
+			f.hf[1].hashBatch(keys + b, k, h2);
+			f.hf[2].hashBatch(keys + b, k, h3);
+			f.hf[3].hashBatch(keys + b, k, h4);
+			for (size_t i=0; i<k; i++) {
+				nodes(h1[i], h2[i], h3[i]);
+				__builtin_prefetch(g.address(h1[i]));
+				__builtin_prefetch(g.address(h2[i]));
+				__builtin_prefetch(g.address(h3[i]));
+			}
+			for (size_t i=0; i<k; i++) {
+				out[b+i] = combine(h1[i], h2[i], h3[i]) == fingerprint(h4[i]);
+			}
+		}
+	}
+};
+
+using XorFilter8 = XorFilter<8, false>;
+using XorFilter16 = XorFilter<16, false>;
+using FuseFilter8 = XorFilter<8, true>;
+using FuseFilter16 = XorFilter<16, true>;